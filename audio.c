@@ -0,0 +1,315 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include "audio.h"
+#include "stats.h"
+
+/* limits for the timer driven backends */
+#define TIMER_MIN_RATE   8000
+#define TIMER_MAX_RATE   192000
+#define TIMER_MAX_FRAMES 8192
+
+static char lastError[256];
+
+
+/* -------------------------------------------------------------------------------------
+	timer driven backends: null, file and pipe share the thread that calls the callback
+	once per block period. The block is due at the deadline, and the next period starts
+	from there, so the average rate is exact even if single wakeups are late.
+------------------------------------------------------------------------------------- */
+typedef struct
+{
+	pthread_t   thread;
+	atomic_int  run;
+	FILE       *out;       /* NULL for the null backend */
+	int         isPipe;
+	float      *buf;
+} TimerSink;
+
+static void addNs(struct timespec *t, long long ns)
+{
+	ns += t->tv_nsec;
+	t->tv_sec += ns / 1000000000;
+	t->tv_nsec = ns % 1000000000;
+}
+
+static long long diffNs(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000000LL + (a->tv_nsec - b->tv_nsec);
+}
+
+/* -------------------------------------------------------------------------------------
+	timerThread: a block that is finished after its deadline is reported as an output
+	underflow with the next block, as a sound card would. If the thread falls more than
+	a period behind, the lost time is skipped instead of rendering blocks back to back
+	to catch up.
+------------------------------------------------------------------------------------- */
+static void *timerThread(void *arg)
+{
+	AudioStream *s = arg;
+	TimerSink *t = s->impl;
+	long long period = (long long)s->framecount * 1000000000LL / s->samplerate, late;
+	struct timespec deadline, now;
+	AudioStatus status;
+
+	status.xrun = 0;
+	status.latency = (double)s->framecount / s->samplerate;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	while (atomic_load_explicit(&t->run, memory_order_acquire)) {
+		addNs(&deadline, period);
+		s->callback(t->buf, s->framecount, &status, s->user);
+		if (t->out != NULL && fwrite(t->buf, AUDIO_CHANNELS * sizeof(float), s->framecount, t->out) != s->framecount) {
+			/* the file is full or the reader of the pipe has gone, the synth keeps running
+			   and the output is discarded from now on */
+			if (t->isPipe)
+				pclose(t->out);
+			else
+				fclose(t->out);
+			t->out = NULL;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = diffNs(&now, &deadline);
+		status.xrun = (late > 0) ? 1 << XRUN_OUT_UNDERFLOW : 0;
+		if (late > period)
+			deadline = now;
+		else if (late < 0)
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+	}
+	return NULL;
+}
+
+static int timerOpen(AudioStream *s, FILE *out, int isPipe)
+{
+	TimerSink *t;
+
+	if (s->samplerate < TIMER_MIN_RATE) s->samplerate = TIMER_MIN_RATE;
+	if (s->samplerate > TIMER_MAX_RATE) s->samplerate = TIMER_MAX_RATE;
+	if (s->framecount < 1) s->framecount = 1;
+	if (s->framecount > TIMER_MAX_FRAMES) s->framecount = TIMER_MAX_FRAMES;
+
+	t = malloc(sizeof(TimerSink));
+	t->out = out;
+	t->isPipe = isPipe;
+	t->buf = malloc(s->framecount * AUDIO_CHANNELS * sizeof(float));
+	atomic_init(&t->run, 0);
+	s->impl = t;
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	timerStart: the thread is given real-time priority if the system allows it, as the
+	audio thread of a sound card would have
+------------------------------------------------------------------------------------- */
+static int timerStart(AudioStream *s)
+{
+	TimerSink *t = s->impl;
+	struct sched_param param;
+	pthread_attr_t attr;
+	int err;
+
+	atomic_store_explicit(&t->run, 1, memory_order_release);
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10;
+	pthread_attr_setschedparam(&attr, &param);
+	err = pthread_create(&t->thread, &attr, timerThread, s);
+	pthread_attr_destroy(&attr);
+	if (err != 0)
+		err = pthread_create(&t->thread, NULL, timerThread, s);
+	if (err != 0) {
+		snprintf(s->error, sizeof(s->error), "cannot start the audio thread");
+		return 1;
+	}
+	return 0;
+}
+
+static void timerStop(AudioStream *s)
+{
+	TimerSink *t = s->impl;
+
+	atomic_store_explicit(&t->run, 0, memory_order_release);
+	pthread_join(t->thread, NULL);
+}
+
+static void timerClose(AudioStream *s)
+{
+	TimerSink *t = s->impl;
+
+	if (t == NULL)
+		return;
+	if (t->out != NULL) {
+		if (t->isPipe)
+			pclose(t->out);
+		else
+			fclose(t->out);
+	}
+	free(t->buf);
+	free(t);
+}
+
+/* -------------------------------------------------------------------------------------
+	nullOpen, fileOpen, pipeOpen
+------------------------------------------------------------------------------------- */
+static int nullOpen(AudioStream *s, const char *arg)
+{
+	return timerOpen(s, NULL, 0);
+}
+
+static int fileOpen(AudioStream *s, const char *arg)
+{
+	FILE *f;
+
+	if (arg == NULL || *arg == 0) {
+		snprintf(s->error, sizeof(s->error), "needs a file name");
+		return 1;
+	}
+	f = fopen(arg, "wb");
+	if (f == NULL) {
+		snprintf(s->error, sizeof(s->error), "cannot create %s", arg);
+		return 1;
+	}
+	return timerOpen(s, f, 0);
+}
+
+static int pipeOpen(AudioStream *s, const char *arg)
+{
+	FILE *f;
+
+	if (arg == NULL || *arg == 0) {
+		snprintf(s->error, sizeof(s->error), "needs a command");
+		return 1;
+	}
+	/* if the command exits, writing fails instead of ending the synth */
+	signal(SIGPIPE, SIG_IGN);
+	f = popen(arg, "w");
+	if (f == NULL) {
+		snprintf(s->error, sizeof(s->error), "cannot run %s", arg);
+		return 1;
+	}
+	return timerOpen(s, f, 1);
+}
+
+static const AudioBackend nullBackend = { "null", nullOpen, timerStart, timerStop, timerClose };
+static const AudioBackend fileBackend = { "file", fileOpen, timerStart, timerStop, timerClose };
+static const AudioBackend pipeBackend = { "pipe", pipeOpen, timerStart, timerStop, timerClose };
+
+/* the first one is the default */
+static const AudioBackend *backends[] = {
+#ifdef HAVE_PORTAUDIO
+	&paBackend,
+#endif
+	&nullBackend,
+	&fileBackend,
+	&pipeBackend,
+	NULL
+};
+
+
+/* -------------------------------------------------------------------------------------
+	audioOpen: spec is "name" or "name:argument"
+------------------------------------------------------------------------------------- */
+AudioStream *audioOpen(const char *spec, unsigned int samplerate, unsigned int framecount)
+{
+	const AudioBackend *b = NULL;
+	const char *arg = NULL;
+	AudioStream *s;
+	size_t len;
+	int i;
+
+	if (spec == NULL || *spec == 0)
+		b = backends[0];
+	else {
+		len = strcspn(spec, ":");
+		if (spec[len] == ':')
+			arg = spec + len + 1;
+		for (i = 0; backends[i] != NULL; i++) {
+			if (strlen(backends[i]->name) == len && strncmp(backends[i]->name, spec, len) == 0)
+				b = backends[i];
+		}
+	}
+	if (b == NULL) {
+		snprintf(lastError, sizeof(lastError), "unknown audio backend %s, the backends are: %s", spec, audioBackends());
+		return NULL;
+	}
+
+	s = malloc(sizeof(AudioStream));
+	s->backend = b;
+	s->samplerate = samplerate;
+	s->framecount = framecount;
+	s->callback = NULL;
+	s->user = NULL;
+	s->running = 0;
+	s->error[0] = 0;
+	s->impl = NULL;
+	if (b->open(s, arg) != 0) {
+		snprintf(lastError, sizeof(lastError), "%s: %s", b->name, s->error);
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+const char *audioError()
+{
+	return lastError;
+}
+
+/* -------------------------------------------------------------------------------------
+	audioStart, audioStop, audioClose
+------------------------------------------------------------------------------------- */
+int audioStart(AudioStream *s, AudioCallback callback, void *user)
+{
+	if (s->running)
+		return 0;
+	s->callback = callback;
+	s->user = user;
+	if (s->backend->start(s) != 0) {
+		snprintf(lastError, sizeof(lastError), "%s: %s", s->backend->name, s->error);
+		return 1;
+	}
+	s->running = 1;
+	return 0;
+}
+
+void audioStop(AudioStream *s)
+{
+	if (!s->running)
+		return;
+	s->backend->stop(s);
+	s->running = 0;
+}
+
+void audioClose(AudioStream *s)
+{
+	if (s == NULL)
+		return;
+	audioStop(s);
+	s->backend->close(s);
+	free(s);
+}
+
+/* -------------------------------------------------------------------------------------
+	audioBackends
+------------------------------------------------------------------------------------- */
+const char *audioBackends()
+{
+	static char names[64];
+	int i;
+
+	names[0] = 0;
+	for (i = 0; backends[i] != NULL; i++) {
+		if (i > 0)
+			strcat(names, " ");
+		strcat(names, backends[i]->name);
+	}
+	return names;
+}
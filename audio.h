@@ -0,0 +1,93 @@
+
+/*-----------------------------------------------------------------------------------
+    AUDIO
+
+    Audio output backends. The synth is driven by a callback that renders one block
+	of interleaved stereo float frames; a backend decides where the blocks go and
+	when the callback is called.
+
+	-portaudio: the sound card, through PortAudio. The argument selects the
+	            output device by name, it can be a shell wildcard pattern
+	-null:      no output. A real-time thread calls the callback on a high
+	            resolution timer, once per block period, so the synth runs against
+	            the same deadlines as with a sound card. Blocks that are not ready
+	            by their deadline are reported as output underflows
+	-file:      like null, and the blocks are written to a file as raw 32-bit
+	            float samples. The file can be a named pipe
+	-pipe:      like file, but the blocks are written into the standard input of
+	            a command, for example a player
+
+	A backend is chosen with a string "name" or "name:argument", e.g. "null",
+	"file:out.raw" or "pipe:aplay -f FLOAT_LE -c 2 -r 44100". The samplerate and
+	block size are requests: the backend may change them when the stream is
+	opened, and the negotiated values are in the stream before it is started.
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef AUDIO_H
+#define AUDIO_H
+
+/* channels of the output, always interleaved stereo */
+#define AUDIO_CHANNELS 2
+
+/* state of the stream for one block */
+typedef struct
+{
+	int    xrun;      /* XRUN_* bits of stats.h */
+	double latency;   /* seconds from the callback to the output, 0 if not known */
+} AudioStatus;
+
+typedef void (*AudioCallback)(float *out, unsigned long frames, const AudioStatus *status, void *user);
+
+typedef struct AudioStream AudioStream;
+
+/* a backend: functions return 0 on success */
+typedef struct
+{
+	const char *name;
+	int  (*open)(AudioStream *s, const char *arg);
+	int  (*start)(AudioStream *s);
+	void (*stop)(AudioStream *s);
+	void (*close)(AudioStream *s);
+} AudioBackend;
+
+struct AudioStream
+{
+	const AudioBackend *backend;
+	unsigned int samplerate;  /* negotiated when opened */
+	unsigned int framecount;  /* frames per callback, the largest block if it varies */
+	AudioCallback callback;
+	void *user;
+	int   running;
+	char  error[128];         /* why the backend failed */
+	void *impl;               /* state of the backend */
+};
+
+
+/*---------------------------------------------------------------------------
+	audioOpen opens a stream on the backend given by spec, NULL for the
+	default (portaudio when it is built in, otherwise null). Returns NULL if
+	the backend is unknown or cannot be opened, audioError tells why.
+------------------------------------------------------------------------------*/
+AudioStream *audioOpen(const char *spec, unsigned int samplerate, unsigned int framecount);
+const char *audioError();
+
+/*---------------------------------------------------------------------------
+	audioStart starts calling callback. audioStop returns after the last call
+	has finished. audioClose stops the stream if needed and frees it.
+------------------------------------------------------------------------------*/
+int audioStart(AudioStream *s, AudioCallback callback, void *user);
+void audioStop(AudioStream *s);
+void audioClose(AudioStream *s);
+
+/*---------------------------------------------------------------------------
+	audioBackends returns the names of the built-in backends, separated by
+	spaces
+------------------------------------------------------------------------------*/
+const char *audioBackends();
+
+#ifdef HAVE_PORTAUDIO
+extern const AudioBackend paBackend;
+#endif
+
+#endif
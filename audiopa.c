@@ -0,0 +1,131 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <portaudio.h>
+#include "audio.h"
+#include "stats.h"
+
+
+/* -------------------------------------------------------------------------------------
+	paCallback: the status flags of the device are passed on as XRUN_* bits
+------------------------------------------------------------------------------------- */
+static int paCallback(const void *input, void *output, unsigned long frames,
+                      const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags flags, void *user)
+{
+	AudioStream *s = user;
+	AudioStatus status;
+
+	status.xrun = 0;
+	if (flags & paInputUnderflow)  status.xrun |= 1 << XRUN_IN_UNDERFLOW;
+	if (flags & paInputOverflow)   status.xrun |= 1 << XRUN_IN_OVERFLOW;
+	if (flags & paOutputUnderflow) status.xrun |= 1 << XRUN_OUT_UNDERFLOW;
+	if (flags & paOutputOverflow)  status.xrun |= 1 << XRUN_OUT_OVERFLOW;
+	if (flags & paPrimingOutput)   status.xrun |= 1 << XRUN_PRIMING;
+	status.latency = 0;
+	if (timeInfo != NULL)
+		status.latency = timeInfo->outputBufferDacTime - timeInfo->currentTime;
+
+	s->callback(output, frames, &status, s->user);
+	return paContinue;
+}
+
+/* -------------------------------------------------------------------------------------
+	findDevice: the first stereo output whose name is the pattern or matches it as a
+	shell wildcard pattern, paNoDevice if none
+------------------------------------------------------------------------------------- */
+static PaDeviceIndex findDevice(const char *pattern)
+{
+	const PaDeviceInfo *dev;
+	PaDeviceIndex i;
+
+	for (i = 0; i < Pa_GetDeviceCount(); i++) {
+		dev = Pa_GetDeviceInfo(i);
+		if (dev != NULL && dev->maxOutputChannels >= AUDIO_CHANNELS
+		    && (strcmp(dev->name, pattern) == 0 || fnmatch(pattern, dev->name, 0) == 0))
+			return i;
+	}
+	return paNoDevice;
+}
+
+/* -------------------------------------------------------------------------------------
+	paOpen: the device named by the argument, or the default output device, is opened
+	with the requested samplerate if it supports it, otherwise with the default
+	samplerate of the device. The block size is kept, PortAudio adapts it to the device
+	if needed.
+------------------------------------------------------------------------------------- */
+static int paOpen(AudioStream *s, const char *arg)
+{
+	PaStreamParameters out;
+	const PaDeviceInfo *dev;
+	const PaStreamInfo *info;
+	PaStream *stream;
+	PaError err;
+
+	err = Pa_Initialize();
+	if (err != paNoError) {
+		snprintf(s->error, sizeof(s->error), "%s", Pa_GetErrorText(err));
+		return 1;
+	}
+	if (arg != NULL && arg[0] != '\0')
+		out.device = findDevice(arg);
+	else
+		out.device = Pa_GetDefaultOutputDevice();
+	dev = (out.device != paNoDevice) ? Pa_GetDeviceInfo(out.device) : NULL;
+	if (dev == NULL) {
+		if (arg != NULL && arg[0] != '\0')
+			snprintf(s->error, sizeof(s->error), "no output device matches %s", arg);
+		else
+			snprintf(s->error, sizeof(s->error), "no output device");
+		Pa_Terminate();
+		return 1;
+	}
+	out.channelCount = AUDIO_CHANNELS;
+	out.sampleFormat = paFloat32;
+	out.suggestedLatency = dev->defaultLowOutputLatency;
+	out.hostApiSpecificStreamInfo = NULL;
+
+	if (Pa_IsFormatSupported(NULL, &out, s->samplerate) != paFormatIsSupported)
+		s->samplerate = dev->defaultSampleRate;
+
+	err = Pa_OpenStream(&stream, NULL, &out, s->samplerate, s->framecount, paNoFlag, paCallback, s);
+	if (err != paNoError) {
+		snprintf(s->error, sizeof(s->error), "%s", Pa_GetErrorText(err));
+		Pa_Terminate();
+		return 1;
+	}
+	info = Pa_GetStreamInfo(stream);
+	if (info != NULL && info->sampleRate > 0)
+		s->samplerate = info->sampleRate + 0.5;
+	s->impl = stream;
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	paStart, paStop, paClose: the stream is aborted, not drained, so stopping takes no
+	longer than the callback that is running. Pa_AbortStream returns after it
+------------------------------------------------------------------------------------- */
+static int paStart(AudioStream *s)
+{
+	PaError err = Pa_StartStream(s->impl);
+
+	if (err != paNoError) {
+		snprintf(s->error, sizeof(s->error), "%s", Pa_GetErrorText(err));
+		return 1;
+	}
+	return 0;
+}
+
+static void paStop(AudioStream *s)
+{
+	Pa_AbortStream(s->impl);
+}
+
+static void paClose(AudioStream *s)
+{
+	Pa_CloseStream(s->impl);
+	Pa_Terminate();
+}
+
+const AudioBackend paBackend = { "portaudio", paOpen, paStart, paStop, paClose };
@@ -0,0 +1,232 @@
+/*-----------------------------------------------------------------------------------------
+
+	ESP-1 render benchmark
+
+	Measures the cost of the synthesis engine without any audio device. The renderer
+	is run through a sweep of waveforms, envelope stages, buffer sizes (framecount),
+	number of voices and midi event density. For every case one line is printed with
+	the cost per sample and the mean, p99 and worst time of one block, compared to the
+	real-time deadline of the block.
+
+	The output is CSV, or JSON lines with -j, so results of different builds can be
+	compared by scripts.
+
+	usage: esp1bench [-j] [-q] [-s seconds] [-r samplerate]
+	       -j  JSON lines instead of CSV
+	       -q  quick sweep with fewer cases
+	       -s  length of audio rendered for each case (default 1 s)
+
+-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "synth.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+/* frames rendered before measuring, so that the attack of the SUS cases is over */
+#define WARMUP_FRAMES 4096
+
+static const char *waveName[] = { "", "PUL", "TRI", "SAW", "SIN" };
+static const char *stageName[] = { "ATT", "DEC", "SUS", "REL" };
+
+
+/* ------------------------------------------------------------------------------------------
+	nanos: monotonic clock in nanoseconds
+--------------------------------------------------------------------------------------------*/
+static long long nanos()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static unsigned long long cycles()
+{
+#ifdef HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static int compareLong(const void *a, const void *b)
+{
+	long long x = *(const long long*)a, y = *(const long long*)b;
+	return (x > y) - (x < y);
+}
+
+static void sendEvent(SynthData *syn, int status, int data1, int data2)
+{
+	PmEvent ev;
+	ev.message = Pm_Message(status, data1, data2);
+	ev.timestamp = 0;
+	handleMidiEvent(&ev, syn);
+}
+
+/* ------------------------------------------------------------------------------------------
+	setupCase: the synth is reset, and voices notes are started so that all of them stay
+	in given envelope stage for the whole measurement
+--------------------------------------------------------------------------------------------*/
+static void setupCase(SynthData *syn, int waveform, int stage, int voices)
+{
+	EnvParams *env;
+	int i, p;
+
+	resetVoicePool(syn->ad->voices);
+	for (p = 0; p < NUM_PARTS; p++) {
+		env = &syn->ad->part[p].env[ENV_AMP];
+		syn->ad->part[p].waveform = waveform;
+		syn->ad->part[p].hold = 0;
+		sendEvent(syn, PITCH_WH | p, 0, PWHEEL_MID >> 7);
+
+		switch (stage) {
+			case ATT:  /* the longest attack */
+				env->value[ATT] = ATT_MAX; env->value[DEC] = 0; env->value[SUS] = 100; env->value[REL] = 0;
+				break;
+			case DEC:  /* the longest decay down to silence */
+				env->value[ATT] = 0; env->value[DEC] = DEC_MAX; env->value[SUS] = 0; env->value[REL] = 0;
+				break;
+			case SUS:
+				env->value[ATT] = 0; env->value[DEC] = 0; env->value[SUS] = 60; env->value[REL] = 0;
+				break;
+			case REL:  /* notes are released after warmup, with the longest release */
+				env->value[ATT] = 0; env->value[DEC] = 0; env->value[SUS] = 100; env->value[REL] = REL_MAX;
+				break;
+		}
+		envUpdate(env);
+	}
+	for (i = 0; i < voices; i++)
+		sendEvent(syn, NOTE_ON | (i / 64), 36 + i % 64, 100);
+}
+
+/* ------------------------------------------------------------------------------------------
+	runCase: renders the case and prints the result line
+--------------------------------------------------------------------------------------------*/
+static void runCase(SynthData *syn, int waveform, int stage, unsigned int frames, int voices,
+                    int density, double length, int json)
+{
+	int blocks = length * samplerate / frames, b, i;
+	long long *times, total = 0, t;
+	unsigned long long c, totalCycles = 0;
+	float *out = malloc(frames * 2 * sizeof(float));
+	PmEvent *events = malloc((density + 1) * sizeof(PmEvent));
+	unsigned long *at = malloc((density + 1) * sizeof(unsigned long));
+	double deadline = 1e9 * frames / samplerate, nsPerSample, cyclesPerSample;
+
+	if (blocks < 1)
+		blocks = 1;
+	times = malloc(blocks * sizeof(long long));
+
+	setupCase(syn, waveform, stage, voices);
+	for (b = 0; b < WARMUP_FRAMES / frames; b++)
+		renderFrames(syn, out, frames);
+	if (stage == REL) {
+		for (i = 0; i < voices; i++)
+			sendEvent(syn, NOTE_OFF | (i / 64), 36 + i % 64, 0);
+	}
+
+	/* the events are spread evenly over the block: mod wheel and pitch wheel messages, so
+	   that the number of voices does not change */
+	for (i = 0; i < density; i++) {
+		if (i % 2 == 0)
+			events[i].message = Pm_Message(CONTROL, MOD_WHEEL, (i * 7) & 0x7F);
+		else
+			events[i].message = Pm_Message(PITCH_WH, 0, (PWHEEL_MID >> 7) + (i % 8) - 4);
+		events[i].timestamp = 0;
+		at[i] = (unsigned long)i * frames / density;
+	}
+
+	for (b = 0; b < blocks; b++) {
+		c = cycles();
+		t = nanos();
+		renderEvents(syn, out, frames, events, at, density);
+		times[b] = nanos() - t;
+		totalCycles += cycles() - c;
+		total += times[b];
+	}
+
+	qsort(times, blocks, sizeof(long long), compareLong);
+	nsPerSample = (double)total / ((double)blocks * frames);
+	cyclesPerSample = (double)totalCycles / ((double)blocks * frames);
+
+	if (json)
+		printf("{\"kernels\":\"%s\",\"waveform\":\"%s\",\"stage\":\"%s\",\"framecount\":%u,\"voices\":%d,"
+		       "\"events\":%d,\"blocks\":%d,\"ns_per_sample\":%.2f,\"cycles_per_sample\":%.1f,"
+		       "\"mean_block_us\":%.3f,\"p99_block_us\":%.3f,\"worst_block_us\":%.3f,"
+		       "\"deadline_us\":%.3f,\"worst_load\":%.4f}\n",
+		       dsp.name, waveName[waveform], stageName[stage], frames, voices, density, blocks,
+		       nsPerSample, cyclesPerSample, total / 1000.0 / blocks, times[(int)(blocks * 0.99)] / 1000.0,
+		       times[blocks - 1] / 1000.0, deadline / 1000, times[blocks - 1] / deadline);
+	else
+		printf("%s,%s,%s,%u,%d,%d,%d,%.2f,%.1f,%.3f,%.3f,%.3f,%.3f,%.4f\n",
+		       dsp.name, waveName[waveform], stageName[stage], frames, voices, density, blocks,
+		       nsPerSample, cyclesPerSample, total / 1000.0 / blocks, times[(int)(blocks * 0.99)] / 1000.0,
+		       times[blocks - 1] / 1000.0, deadline / 1000, times[blocks - 1] / deadline);
+	fflush(stdout);
+
+	free(times);
+	free(out);
+	free(events);
+	free(at);
+}
+
+/*-------------------------------------------------------------------------------------------
+  main
+---------------------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	static const unsigned int frameSweep[] = { 32, 64, 128, 256, 512, 1024 };
+	static const int voiceSweep[] = { 1, 8, 32, 64 };
+	static const int densitySweep[] = { 0, 4, 32 };
+	int opt, json = 0, quick = 0, w, st, f, v, d;
+	int nframes = 6, nvoices = 4, ndensity = 3;
+	double length = 1.0;
+	SynthData *synth;
+
+	samplerate = 44100;
+	framecount = 128;
+
+	while ((opt = getopt(argc, argv, "jqs:r:")) != -1) {
+		switch (opt) {
+			case 'j': json = 1; break;
+			case 'q': quick = 1; break;
+			case 's': length = atof(optarg); break;
+			case 'r': samplerate = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: esp1bench [-j] [-q] [-s seconds] [-r samplerate]\n");
+				return 1;
+		}
+	}
+	if (length <= 0) {
+		fprintf(stderr, "The length must be more than 0 seconds\n");
+		return 1;
+	}
+	if (quick) {
+		nframes = 3;    /* 32, 64, 128 */
+		nvoices = 2;    /* 1, 8 */
+		ndensity = 2;   /* 0, 4 */
+	}
+
+	synth = initSynthData();
+
+	if (!json)
+		printf("kernels,waveform,stage,framecount,voices,events,blocks,ns_per_sample,cycles_per_sample,"
+		       "mean_block_us,p99_block_us,worst_block_us,deadline_us,worst_load\n");
+
+	for (w = PUL; w <= SIN; w++)
+		for (st = ATT; st <= REL; st++)
+			for (f = 0; f < nframes; f++)
+				for (v = 0; v < nvoices; v++)
+					for (d = 0; d < ndensity; d++)
+						runCase(synth, w, st, frameSweep[f], voiceSweep[v], densitySweep[d], length, json);
+
+	freeSynthData(synth);
+	return 0;
+}
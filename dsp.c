@@ -0,0 +1,521 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_X86
+#include <immintrin.h>
+#endif
+
+DspKernels dsp;
+
+
+/* -------------------------------------------------------------------------------------
+	scalar kernels, used on other processors and for the remainders of the vector
+	loops
+------------------------------------------------------------------------------------- */
+static void clear_c(float *dst, int n)
+{
+	memset(dst, 0, n * sizeof(float));
+}
+
+static void mulAdd_c(float *dst, const float *a, const float *b, float gain, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] += a[i] * b[i] * gain;
+}
+
+static void mulAddRamp_c(float *dst, const float *a, const float *b, float g0, float g1, int n)
+{
+	float d = (g1 - g0) / n;
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] += a[i] * b[i] * (g0 + (i + 1) * d);
+}
+
+static void addScaled_c(float *dst, const float *a, float gain, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] += a[i] * gain;
+}
+
+static float ramp_c(float *dst, float start, float inc, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] = start + (i + 1) * inc;
+	return (n > 0) ? dst[n - 1] : start;
+}
+
+static void fill_c(float *dst, float value, int n)
+{
+	int i;
+	for (i = 0; i < n; i++)
+		dst[i] = value;
+}
+
+static void interleave_c(float *out, const float *left, const float *right, float gain, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		*out++ = left[i] * gain;
+		*out++ = right[i] * gain;
+	}
+}
+
+/* the top bits of the phase are the table index, the rest the fraction */
+static inline float lookup(const float *t, int bits, unsigned int phase)
+{
+	unsigned int i = phase >> (32 - bits);
+	float f = (phase & ((1u << (32 - bits)) - 1)) * (1.0f / (1u << (32 - bits)));
+	return t[i] + f * (t[i + 1] - t[i]);
+}
+
+static unsigned int osc_c(float *dst, const float *t, int bits, unsigned int phase,
+                          unsigned int inc, int dinc, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		dst[i] = lookup(t, bits, phase);
+		phase += inc;
+		inc += dinc;
+	}
+	return phase;
+}
+
+static unsigned int oscPulse_c(float *dst, const float *t, int bits, unsigned int phase,
+                               unsigned int inc, int dinc, unsigned int width, float offset, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		dst[i] = lookup(t, bits, phase) - lookup(t, bits, phase - width) + offset;
+		phase += inc;
+		inc += dinc;
+	}
+	return phase;
+}
+
+/* the filter from sample i0 on, one lane after another */
+static void svfFrom_c(float *const *x, float *ic1, float *ic2, const float *coef, int i0, int n)
+{
+	const float *c;
+	float s1, s2, v1, v2, v3;
+	int l, i;
+
+	for (l = 0; l < FILTER_LANES; l++) {
+		s1 = ic1[l];
+		s2 = ic2[l];
+		for (i = i0; i < n; i++) {
+			c = coef + (i / FILTER_CHUNK) * FILTER_COEFS * FILTER_LANES + l;
+			v3 = x[l][i] - s2;
+			v1 = c[0] * s1 + c[FILTER_LANES] * v3;
+			v2 = s2 + c[FILTER_LANES] * s1 + c[2 * FILTER_LANES] * v3;
+			s1 = v1 + v1 - s1;
+			s2 = v2 + v2 - s2;
+			x[l][i] = v2;
+		}
+		ic1[l] = s1;
+		ic2[l] = s2;
+	}
+}
+
+static void svf_c(float *const *x, float *ic1, float *ic2, const float *coef, int n)
+{
+	svfFrom_c(x, ic1, ic2, coef, 0, n);
+}
+
+
+#ifdef DSP_X86
+/* -------------------------------------------------------------------------------------
+	SSE kernels, 4 samples at a time
+------------------------------------------------------------------------------------- */
+__attribute__((target("sse2")))
+static void mulAdd_sse(float *dst, const float *a, const float *b, float gain, int n)
+{
+	__m128 g = _mm_set1_ps(gain);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+		              _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), g)));
+	mulAdd_c(dst + i, a + i, b + i, gain, n - i);
+}
+
+__attribute__((target("sse2")))
+static void mulAddRamp_sse(float *dst, const float *a, const float *b, float g0, float g1, int n)
+{
+	float d = (g1 - g0) / n;
+	__m128 g = _mm_add_ps(_mm_set1_ps(g0), _mm_mul_ps(_mm_setr_ps(1, 2, 3, 4), _mm_set1_ps(d)));
+	__m128 step = _mm_set1_ps(4 * d);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+		              _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), g)));
+		g = _mm_add_ps(g, step);
+	}
+	for (; i < n; i++)
+		dst[i] += a[i] * b[i] * (g0 + (i + 1) * d);
+}
+
+__attribute__((target("sse2")))
+static void addScaled_sse(float *dst, const float *a, float gain, int n)
+{
+	__m128 g = _mm_set1_ps(gain);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(a + i), g)));
+	addScaled_c(dst + i, a + i, gain, n - i);
+}
+
+__attribute__((target("sse2")))
+static float ramp_sse(float *dst, float start, float inc, int n)
+{
+	__m128 s = _mm_set1_ps(start), d = _mm_set1_ps(inc);
+	__m128 idx = _mm_setr_ps(1, 2, 3, 4), four = _mm_set1_ps(4);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(s, _mm_mul_ps(idx, d)));
+		idx = _mm_add_ps(idx, four);
+	}
+	for (; i < n; i++)
+		dst[i] = start + (i + 1) * inc;
+	return (n > 0) ? dst[n - 1] : start;
+}
+
+__attribute__((target("sse2")))
+static void fill_sse(float *dst, float value, int n)
+{
+	__m128 v = _mm_set1_ps(value);
+	int i;
+	for (i = 0; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, v);
+	fill_c(dst + i, value, n - i);
+}
+
+__attribute__((target("sse2")))
+static void interleave_sse(float *out, const float *left, const float *right, float gain, int n)
+{
+	__m128 g = _mm_set1_ps(gain), l, r;
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		l = _mm_mul_ps(_mm_loadu_ps(left + i), g);
+		r = _mm_mul_ps(_mm_loadu_ps(right + i), g);
+		_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+	}
+	interleave_c(out + 2 * i, left + i, right + i, gain, n - i);
+}
+
+/* the filter on lanes 0-3 and 4-7, 4 samples at a time: a 4 x 4 block of samples is
+   transposed so that each vector has one sample of the 4 lanes */
+__attribute__((target("sse2")))
+static void svf_sse(float *const *x, float *ic1, float *ic2, const float *coef, int n)
+{
+	__m128 r[4], a1, a2, a3, s1, s2, v1, v2, v3;
+	const float *c;
+	int h, i, k;
+
+	for (h = 0; h < FILTER_LANES; h += 4) {
+		s1 = _mm_loadu_ps(ic1 + h);
+		s2 = _mm_loadu_ps(ic2 + h);
+		for (i = 0; i + 4 <= n; i += 4) {
+			c = coef + (i / FILTER_CHUNK) * FILTER_COEFS * FILTER_LANES + h;
+			a1 = _mm_loadu_ps(c);
+			a2 = _mm_loadu_ps(c + FILTER_LANES);
+			a3 = _mm_loadu_ps(c + 2 * FILTER_LANES);
+			for (k = 0; k < 4; k++)
+				r[k] = _mm_loadu_ps(x[h + k] + i);
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			for (k = 0; k < 4; k++) {
+				v3 = _mm_sub_ps(r[k], s2);
+				v1 = _mm_add_ps(_mm_mul_ps(a1, s1), _mm_mul_ps(a2, v3));
+				v2 = _mm_add_ps(_mm_add_ps(s2, _mm_mul_ps(a2, s1)), _mm_mul_ps(a3, v3));
+				s1 = _mm_sub_ps(_mm_add_ps(v1, v1), s1);
+				s2 = _mm_sub_ps(_mm_add_ps(v2, v2), s2);
+				r[k] = v2;
+			}
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			for (k = 0; k < 4; k++)
+				_mm_storeu_ps(x[h + k] + i, r[k]);
+		}
+		_mm_storeu_ps(ic1 + h, s1);
+		_mm_storeu_ps(ic2 + h, s2);
+	}
+	svfFrom_c(x, ic1, ic2, coef, n & ~3, n);
+}
+
+
+/* -------------------------------------------------------------------------------------
+	AVX kernels, 8 samples at a time
+------------------------------------------------------------------------------------- */
+__attribute__((target("avx")))
+static void mulAdd_avx(float *dst, const float *a, const float *b, float gain, int n)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+		                 _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), g)));
+	mulAdd_c(dst + i, a + i, b + i, gain, n - i);
+}
+
+__attribute__((target("avx")))
+static void mulAddRamp_avx(float *dst, const float *a, const float *b, float g0, float g1, int n)
+{
+	float d = (g1 - g0) / n;
+	__m256 g = _mm256_add_ps(_mm256_set1_ps(g0), _mm256_mul_ps(_mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8),
+	                                                            _mm256_set1_ps(d)));
+	__m256 step = _mm256_set1_ps(8 * d);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i),
+		                 _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), g)));
+		g = _mm256_add_ps(g, step);
+	}
+	for (; i < n; i++)
+		dst[i] += a[i] * b[i] * (g0 + (i + 1) * d);
+}
+
+__attribute__((target("avx")))
+static void addScaled_avx(float *dst, const float *a, float gain, int n)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(a + i), g)));
+	addScaled_c(dst + i, a + i, gain, n - i);
+}
+
+__attribute__((target("avx")))
+static float ramp_avx(float *dst, float start, float inc, int n)
+{
+	__m256 s = _mm256_set1_ps(start), d = _mm256_set1_ps(inc);
+	__m256 idx = _mm256_setr_ps(1, 2, 3, 4, 5, 6, 7, 8), eight = _mm256_set1_ps(8);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(s, _mm256_mul_ps(idx, d)));
+		idx = _mm256_add_ps(idx, eight);
+	}
+	for (; i < n; i++)
+		dst[i] = start + (i + 1) * inc;
+	return (n > 0) ? dst[n - 1] : start;
+}
+
+__attribute__((target("avx")))
+static void fill_avx(float *dst, float value, int n)
+{
+	__m256 v = _mm256_set1_ps(value);
+	int i;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, v);
+	fill_c(dst + i, value, n - i);
+}
+
+__attribute__((target("avx")))
+static void interleave_avx(float *out, const float *left, const float *right, float gain, int n)
+{
+	__m256 g = _mm256_set1_ps(gain), l, r, lo, hi;
+	int i;
+	for (i = 0; i + 8 <= n; i += 8) {
+		l = _mm256_mul_ps(_mm256_loadu_ps(left + i), g);
+		r = _mm256_mul_ps(_mm256_loadu_ps(right + i), g);
+		/* unpack works inside 128 bit lanes, so the halves are put back in order after it */
+		lo = _mm256_unpacklo_ps(l, r);
+		hi = _mm256_unpackhi_ps(l, r);
+		_mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+		_mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+	}
+	interleave_c(out + 2 * i, left + i, right + i, gain, n - i);
+}
+
+
+/* -------------------------------------------------------------------------------------
+	AVX2 table oscillators, 8 samples at a time. Lane k starts from the phase of sample
+	k, phase + k * inc + dinc * k(k - 1) / 2, and its increment inc + k * dinc. Over 8
+	samples a lane advances by 8 times its increment and 28 * dinc, all modulo 2^32.
+------------------------------------------------------------------------------------- */
+__attribute__((target("avx2")))
+static inline __m256 lookup_avx2(const float *t, int bits, __m256i p)
+{
+	__m256i i = _mm256_srli_epi32(p, 32 - bits);
+	__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(p, _mm256_set1_epi32((1u << (32 - bits)) - 1))),
+	                         _mm256_set1_ps(1.0f / (1u << (32 - bits))));
+	__m256 a = _mm256_i32gather_ps(t, i, 4);
+	__m256 b = _mm256_i32gather_ps(t + 1, i, 4);
+	return _mm256_add_ps(a, _mm256_mul_ps(f, _mm256_sub_ps(b, a)));
+}
+
+__attribute__((target("avx2")))
+static inline void lanes_avx2(unsigned int phase, unsigned int inc, int dinc, __m256i *p, __m256i *v)
+{
+	__m256i k = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i tri = _mm256_setr_epi32(0, 0, 1, 3, 6, 10, 15, 21);
+	__m256i d = _mm256_set1_epi32(dinc);
+
+	*p = _mm256_add_epi32(_mm256_add_epi32(_mm256_set1_epi32(phase), _mm256_mullo_epi32(k, _mm256_set1_epi32(inc))),
+	                      _mm256_mullo_epi32(tri, d));
+	*v = _mm256_add_epi32(_mm256_set1_epi32(inc), _mm256_mullo_epi32(k, d));
+}
+
+__attribute__((target("avx2")))
+static unsigned int osc_avx2(float *dst, const float *t, int bits, unsigned int phase,
+                             unsigned int inc, int dinc, int n)
+{
+	__m256i p, v, step = _mm256_set1_epi32(28u * dinc), dv = _mm256_set1_epi32(8u * dinc);
+	int i;
+
+	lanes_avx2(phase, inc, dinc, &p, &v);
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(dst + i, lookup_avx2(t, bits, p));
+		p = _mm256_add_epi32(p, _mm256_add_epi32(_mm256_slli_epi32(v, 3), step));
+		v = _mm256_add_epi32(v, dv);
+	}
+	/* lane 0 is at sample i. The upper halves of the registers are cleared before the
+	   scalar code, the compiler does not do it before a tail call */
+	phase = _mm_cvtsi128_si32(_mm256_castsi256_si128(p));
+	inc = _mm_cvtsi128_si32(_mm256_castsi256_si128(v));
+	_mm256_zeroupper();
+	return osc_c(dst + i, t, bits, phase, inc, dinc, n - i);
+}
+
+__attribute__((target("avx2")))
+static unsigned int oscPulse_avx2(float *dst, const float *t, int bits, unsigned int phase,
+                                  unsigned int inc, int dinc, unsigned int width, float offset, int n)
+{
+	__m256i p, v, step = _mm256_set1_epi32(28u * dinc), dv = _mm256_set1_epi32(8u * dinc);
+	__m256i w = _mm256_set1_epi32(width);
+	__m256 o = _mm256_set1_ps(offset);
+	int i;
+
+	lanes_avx2(phase, inc, dinc, &p, &v);
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_sub_ps(lookup_avx2(t, bits, p),
+		                                                      lookup_avx2(t, bits, _mm256_sub_epi32(p, w))), o));
+		p = _mm256_add_epi32(p, _mm256_add_epi32(_mm256_slli_epi32(v, 3), step));
+		v = _mm256_add_epi32(v, dv);
+	}
+	phase = _mm_cvtsi128_si32(_mm256_castsi256_si128(p));
+	inc = _mm_cvtsi128_si32(_mm256_castsi256_si128(v));
+	_mm256_zeroupper();
+	return oscPulse_c(dst + i, t, bits, phase, inc, dinc, width, offset, n - i);
+}
+
+/* 8 x 8 transpose: row k of the result has element k of every input row */
+__attribute__((target("avx")))
+static inline void transpose8_avx(__m256 *r)
+{
+	__m256 t[8], u[8];
+	int k;
+
+	for (k = 0; k < 8; k += 2) {
+		t[k] = _mm256_unpacklo_ps(r[k], r[k + 1]);
+		t[k + 1] = _mm256_unpackhi_ps(r[k], r[k + 1]);
+	}
+	for (k = 0; k < 8; k += 4) {
+		u[k] = _mm256_shuffle_ps(t[k], t[k + 2], 0x44);
+		u[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], 0xEE);
+		u[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], 0x44);
+		u[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], 0xEE);
+	}
+	for (k = 0; k < 4; k++) {
+		r[k] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x20);
+		r[k + 4] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x31);
+	}
+}
+
+/* the filter on all 8 lanes, 8 samples at a time */
+__attribute__((target("avx")))
+static void svf_avx(float *const *x, float *ic1, float *ic2, const float *coef, int n)
+{
+	__m256 r[8], a1, a2, a3, s1, s2, v1, v2, v3;
+	const float *c;
+	int i, k;
+
+	s1 = _mm256_loadu_ps(ic1);
+	s2 = _mm256_loadu_ps(ic2);
+	for (i = 0; i + 8 <= n; i += 8) {
+		c = coef + (i / FILTER_CHUNK) * FILTER_COEFS * FILTER_LANES;
+		a1 = _mm256_loadu_ps(c);
+		a2 = _mm256_loadu_ps(c + FILTER_LANES);
+		a3 = _mm256_loadu_ps(c + 2 * FILTER_LANES);
+		for (k = 0; k < 8; k++)
+			r[k] = _mm256_loadu_ps(x[k] + i);
+		transpose8_avx(r);
+		for (k = 0; k < 8; k++) {
+			v3 = _mm256_sub_ps(r[k], s2);
+			v1 = _mm256_add_ps(_mm256_mul_ps(a1, s1), _mm256_mul_ps(a2, v3));
+			v2 = _mm256_add_ps(_mm256_add_ps(s2, _mm256_mul_ps(a2, s1)), _mm256_mul_ps(a3, v3));
+			s1 = _mm256_sub_ps(_mm256_add_ps(v1, v1), s1);
+			s2 = _mm256_sub_ps(_mm256_add_ps(v2, v2), s2);
+			r[k] = v2;
+		}
+		transpose8_avx(r);
+		for (k = 0; k < 8; k++)
+			_mm256_storeu_ps(x[k] + i, r[k]);
+	}
+	_mm256_storeu_ps(ic1, s1);
+	_mm256_storeu_ps(ic2, s2);
+	_mm256_zeroupper();
+	svfFrom_c(x, ic1, ic2, coef, i, n);
+}
+#endif
+
+
+/* -------------------------------------------------------------------------------------
+	dspInit
+------------------------------------------------------------------------------------- */
+void dspInit(const char *force)
+{
+	dsp.name = "scalar";
+	dsp.clear = clear_c;
+	dsp.mulAdd = mulAdd_c;
+	dsp.mulAddRamp = mulAddRamp_c;
+	dsp.addScaled = addScaled_c;
+	dsp.ramp = ramp_c;
+	dsp.fill = fill_c;
+	dsp.interleave = interleave_c;
+	dsp.osc = osc_c;
+	dsp.oscPulse = oscPulse_c;
+	dsp.svf = svf_c;
+
+	if (force != NULL && strcmp(force, "scalar") == 0)
+		return;
+
+#ifdef DSP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		dsp.name = "sse";
+		dsp.mulAdd = mulAdd_sse;
+		dsp.mulAddRamp = mulAddRamp_sse;
+		dsp.addScaled = addScaled_sse;
+		dsp.ramp = ramp_sse;
+		dsp.fill = fill_sse;
+		dsp.interleave = interleave_sse;
+		dsp.svf = svf_sse;
+	}
+	if (force != NULL && strcmp(force, "sse") == 0)
+		return;
+
+	if (__builtin_cpu_supports("avx")) {
+		dsp.name = "avx";
+		dsp.mulAdd = mulAdd_avx;
+		dsp.mulAddRamp = mulAddRamp_avx;
+		dsp.addScaled = addScaled_avx;
+		dsp.ramp = ramp_avx;
+		dsp.fill = fill_avx;
+		dsp.interleave = interleave_avx;
+		dsp.svf = svf_avx;
+	}
+	if (force != NULL && strcmp(force, "avx") == 0)
+		return;
+
+	/* the other kernels gain nothing from avx2, only the oscillators need its gathers */
+	if (__builtin_cpu_supports("avx2")) {
+		dsp.name = "avx2";
+		dsp.osc = osc_avx2;
+		dsp.oscPulse = oscPulse_avx2;
+	}
+#endif
+}
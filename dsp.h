@@ -0,0 +1,81 @@
+
+/*-----------------------------------------------------------------------------------
+    DSP
+
+    Block processing kernels for the renderer. All kernels work on contiguous
+	float buffers, and have a plain C version and SSE/AVX versions on x86. The
+	best version the processor supports is chosen at startup by dspInit, so the
+	same binary runs everywhere.
+
+	-buffers do not need to be aligned
+	-n can be any number of samples, the vector loops handle the remainder
+	-the filter runs FILTER_LANES voices side by side; the vector versions
+	 transpose blocks of samples so each vector holds one sample of every
+	 voice, and give the same results as the C version
+	-the table oscillators use a 32-bit phase accumulator, a full cycle is 2^32
+	 and wraps around by itself. The phase of sample i has a closed form, so
+	 the AVX2 versions compute 8 samples at once with table gathers, and give
+	 exactly the same phases as the C versions
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef DSP_H
+#define DSP_H
+
+#include "filter.h"
+
+/* the largest block the renderer processes at once, longer callbacks are split */
+#define DSP_BLOCK 256
+
+typedef struct
+{
+	const char *name;  /* instruction set of the chosen kernels */
+
+	/* dst[i] = 0 */
+	void (*clear)(float *dst, int n);
+
+	/* dst[i] += a[i] * b[i] * gain */
+	void (*mulAdd)(float *dst, const float *a, const float *b, float gain, int n);
+
+	/* dst[i] += a[i] * b[i] * (g0 + (g1 - g0) * (i + 1) / n), the gain moves from g0 to g1 */
+	void (*mulAddRamp)(float *dst, const float *a, const float *b, float g0, float g1, int n);
+
+	/* dst[i] += a[i] * gain */
+	void (*addScaled)(float *dst, const float *a, float gain, int n);
+
+	/* dst[i] = start + (i + 1) * inc, returns the last value written */
+	float (*ramp)(float *dst, float start, float inc, int n);
+
+	/* dst[i] = value */
+	void (*fill)(float *dst, float value, int n);
+
+	/* out[2i] = left[i] * gain, out[2i + 1] = right[i] * gain */
+	void (*interleave)(float *out, const float *left, const float *right, float gain, int n);
+
+	/* dst[i] = t[phase] linearly interpolated, for a table of 1 << bits samples and one
+	   guard sample. phase advances by inc and inc by dinc every sample, the phase after
+	   the block is returned */
+	unsigned int (*osc)(float *dst, const float *t, int bits, unsigned int phase,
+	                    unsigned int inc, int dinc, int n);
+
+	/* dst[i] = t[phase] - t[phase - width] + offset, the same way */
+	unsigned int (*oscPulse)(float *dst, const float *t, int bits, unsigned int phase,
+	                         unsigned int inc, int dinc, unsigned int width, float offset, int n);
+
+	/* the state variable filter of filter.h on FILTER_LANES buffers x[lane] in place, one voice
+	   in each lane. ic1 and ic2 hold the states of the lanes. coef has FILTER_COEFS rows of
+	   FILTER_LANES values (a1, a2, a3) for each FILTER_CHUNK samples */
+	void (*svf)(float *const *x, float *ic1, float *ic2, const float *coef, int n);
+} DspKernels;
+
+/* the kernels in use, valid after dspInit */
+extern DspKernels dsp;
+
+/*---------------------------------------------------------------------------
+	dspInit checks the processor and selects the fastest kernels.
+	If force is not NULL ("scalar", "sse", "avx", "avx2"), that set is used instead,
+	if the processor supports it.
+------------------------------------------------------------------------------*/
+void dspInit(const char *force);
+
+#endif
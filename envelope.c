@@ -0,0 +1,227 @@
+
+#include <math.h>
+#include "envelope.h"
+#include "dsp.h"
+
+/* the exponential attack aims over the top, like an analog envelope, and stops at 1 */
+#define EXP_ATT_TARGET 1.3f
+
+/* the exponential decay and release times are the times to fall 60 dB */
+#define EXP_EPS 0.001f
+
+
+/* -------------------------------------------------------------------------------------
+	envInit
+------------------------------------------------------------------------------------- */
+void envInit(EnvParams *p, unsigned int att, unsigned int dec, unsigned int sus,
+             unsigned int rel, float samplerate)
+{
+	p->value[ATT] = att;
+	p->value[DEC] = dec;
+	p->value[SUS] = sus;
+	p->value[REL] = rel;
+	p->max_val[ATT] = ATT_MAX;
+	p->max_val[DEC] = DEC_MAX;
+	p->max_val[SUS] = SUS_MAX;
+	p->max_val[REL] = REL_MAX;
+	p->shape = ENV_LINEAR;
+	p->timebase = samplerate / 1000.0f;
+	p->version = 0;
+	envUpdate(p);
+}
+
+/* -------------------------------------------------------------------------------------
+	envUpdate: an attack of 0 is played as 1 ms to prevent an audible pop. Zero decay
+	and release times are handled when the stage starts.
+------------------------------------------------------------------------------------- */
+void envUpdate(EnvParams *p)
+{
+	int i;
+	float samples;
+
+	for (i = ATT; i <= REL; i++) {
+		if (i == SUS)
+			continue;
+		samples = p->value[i] * p->timebase;
+		if (i == ATT && p->value[ATT] == 0)
+			samples = p->timebase;
+		if (samples < 1)
+			samples = 1;
+
+		if (p->shape == ENV_LINEAR) {
+			p->rate[i] = 1.0f / samples;
+			p->lnrate[i] = 0;
+		}
+		else {
+			if (i == ATT)
+				p->lnrate[i] = logf((EXP_ATT_TARGET - 1) / EXP_ATT_TARGET) / samples;
+			else
+				p->lnrate[i] = logf(EXP_EPS) / samples;
+			p->rate[i] = expf(p->lnrate[i]);
+		}
+	}
+	p->sustain = p->value[SUS] * 0.01f;
+	p->version++;
+}
+
+/* -------------------------------------------------------------------------------------
+	enterStage: computes the increment and length of the segment starting from the
+	current level. Stages of zero length are passed through at once.
+------------------------------------------------------------------------------------- */
+static void enterStage(EnvState *e, const EnvParams *p, int stage)
+{
+	int exp = (p->shape == ENV_EXPONENTIAL);
+
+	e->version = p->version;
+	for (;;) {
+		e->stage = stage;
+		e->remaining = 0;
+		switch (stage) {
+			case ATT:
+				if (e->level >= 1) {
+					e->level = 1;
+					stage = DEC;
+					continue;
+				}
+				e->inc = p->rate[ATT];
+				if (exp) {
+					e->target = EXP_ATT_TARGET;
+					e->remaining = ceilf(logf((EXP_ATT_TARGET - 1) / (EXP_ATT_TARGET - e->level)) / p->lnrate[ATT]);
+				}
+				else
+					e->remaining = ceilf((1 - e->level) / p->rate[ATT]);
+				break;
+
+			case DEC:
+				if (p->value[DEC] == 0 || e->level - p->sustain <= (exp ? EXP_EPS : 0)) {
+					e->level = p->sustain;
+					stage = SUS;
+					continue;
+				}
+				if (exp) {
+					e->inc = p->rate[DEC];
+					e->target = p->sustain;
+					e->remaining = ceilf(logf(EXP_EPS / (e->level - p->sustain)) / p->lnrate[DEC]);
+				}
+				else {
+					e->inc = -p->rate[DEC];
+					e->remaining = ceilf((e->level - p->sustain) / p->rate[DEC]);
+				}
+				break;
+
+			case REL:
+				if (p->value[REL] == 0 || e->level <= (exp ? EXP_EPS : 0)) {
+					e->level = 0;
+					stage = OFF;
+					continue;
+				}
+				if (exp) {
+					e->inc = p->rate[REL];
+					e->target = 0;
+					e->remaining = ceilf(logf(EXP_EPS / e->level) / p->lnrate[REL]);
+				}
+				else {
+					e->inc = -p->rate[REL];
+					e->remaining = ceilf(e->level / p->rate[REL]);
+				}
+				break;
+
+			case OFF:
+				e->level = 0;
+				break;
+		}
+		if ((stage == ATT || stage == DEC || stage == REL) && e->remaining < 1)
+			e->remaining = 1;
+		return;
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	nextStage: at the end of a segment the level is set exactly to where the segment
+	was heading, and the next stage starts
+------------------------------------------------------------------------------------- */
+static void nextStage(EnvState *e, const EnvParams *p)
+{
+	switch (e->stage) {
+		case ATT:
+			e->level = 1;
+			enterStage(e, p, DEC);
+			break;
+		case DEC:
+			e->level = p->sustain;
+			enterStage(e, p, SUS);
+			break;
+		case REL:
+			e->level = 0;
+			enterStage(e, p, OFF);
+			break;
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	envReset, envTrigger, envRelease
+------------------------------------------------------------------------------------- */
+void envReset(EnvState *e)
+{
+	e->stage = OFF;
+	e->level = 0;
+	e->inc = 0;
+	e->target = 0;
+	e->remaining = 0;
+	e->version = 0;
+}
+
+void envTrigger(EnvState *e, const EnvParams *p)
+{
+	enterStage(e, p, ATT);
+}
+
+void envRelease(EnvState *e, const EnvParams *p)
+{
+	if (e->stage != OFF)
+		enterStage(e, p, REL);
+}
+
+/* -------------------------------------------------------------------------------------
+	envRender: linear segments are written with the ramp kernel, exponential segments
+	with a one multiply recursion towards the target
+------------------------------------------------------------------------------------- */
+int envRender(EnvState *e, const EnvParams *p, float *out, int n)
+{
+	int pos = 0, len, i;
+	float l, t, c;
+
+	/* the parameters have changed: the segment continues from the current level with the new values */
+	if (e->version != p->version)
+		enterStage(e, p, e->stage);
+
+	while (pos < n) {
+		if (e->stage == SUS) {
+			dsp.fill(out + pos, e->level, n - pos);
+			return 0;
+		}
+		if (e->stage == OFF) {
+			dsp.clear(out + pos, n - pos);
+			return 1;
+		}
+
+		len = (e->remaining < n - pos) ? e->remaining : n - pos;
+		if (p->shape == ENV_LINEAR)
+			e->level = dsp.ramp(out + pos, e->level, e->inc, len);
+		else {
+			l = e->level;
+			t = e->target;
+			c = e->inc;
+			for (i = 0; i < len; i++) {
+				l = t + (l - t) * c;
+				out[pos + i] = l;
+			}
+			e->level = l;
+		}
+		e->remaining -= len;
+		pos += len;
+		if (e->remaining <= 0)
+			nextStage(e, p);
+	}
+	return e->stage == OFF;
+}
@@ -0,0 +1,99 @@
+
+/*-----------------------------------------------------------------------------------
+    ENVELOPE
+
+    ADSR envelope generator. The parameters (EnvParams) are shared by any number of
+	envelope instances (EnvState), for example the amplitude, filter and pitch
+	envelopes of every voice.
+
+	-the per-sample increments and exponential coefficients are computed in
+	 envUpdate, only when a parameter changes
+	-the length of a segment is computed once when a stage starts, so an envelope
+	 is rendered a whole block at a time with no tests or divisions per sample
+	-levels are from 0 to 1, the voice scales them by its velocity
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+/* envelope stages */
+#define ATT 0
+#define DEC 1
+#define SUS 2
+#define REL 3
+#define OFF 4
+
+/* envelope shapes */
+#define ENV_LINEAR      0
+#define ENV_EXPONENTIAL 1
+
+/* envelope instances of a voice */
+#define ENV_AMP    0
+#define ENV_FILTER 1
+#define ENV_PITCH  2
+#define NUM_ENVS   3
+
+#define ATT_MAX 3000
+#define DEC_MAX 3000
+#define SUS_MAX 100
+#define REL_MAX 3000
+
+
+/* envelope parameters */
+typedef struct
+{
+	unsigned int value[4];   /* ATT, DEC, SUS, REL values, times in ms, for SUS the value is % of max amp. OFF needs no time */
+	unsigned int max_val[4];
+	int   shape;             /* ENV_LINEAR or ENV_EXPONENTIAL */
+	float timebase;          /* samples per ms */
+
+	/* computed by envUpdate */
+	float rate[4];           /* linear: level change per sample. exponential: coefficient per sample */
+	float lnrate[4];         /* log of the exponential coefficients */
+	float sustain;           /* sustain level, 0-1 */
+	unsigned int version;    /* changes on every update, so that envelopes notice it */
+} EnvParams;
+
+/* state of one envelope instance */
+typedef struct
+{
+	int   stage;
+	float level;
+	float inc;               /* linear increment or exponential coefficient of the segment */
+	float target;            /* level the exponential segment is heading to */
+	int   remaining;         /* samples left in the segment */
+	unsigned int version;    /* version of the parameters the segment was computed with */
+} EnvState;
+
+
+/*---------------------------------------------------------------------------
+	envInit sets the parameters and computes the coefficients
+------------------------------------------------------------------------------*/
+void envInit(EnvParams *p, unsigned int att, unsigned int dec, unsigned int sus,
+             unsigned int rel, float samplerate);
+
+/*---------------------------------------------------------------------------
+	envUpdate must be called after value[], shape or timebase has been changed
+------------------------------------------------------------------------------*/
+void envUpdate(EnvParams *p);
+
+/* -----------------------------------------------------------------------------
+	envReset puts an envelope to OFF stage at level 0
+------------------------------------------------------------------------------*/
+void envReset(EnvState *e);
+
+/* -----------------------------------------------------------------------------
+	envTrigger starts the attack from the current level, envRelease starts the
+	release stage
+------------------------------------------------------------------------------*/
+void envTrigger(EnvState *e, const EnvParams *p);
+void envRelease(EnvState *e, const EnvParams *p);
+
+/* -----------------------------------------------------------------------------
+	envRender writes n levels of the envelope into out. Returns 1 if the
+	envelope is OFF at the end of the block.
+------------------------------------------------------------------------------*/
+int envRender(EnvState *e, const EnvParams *p, float *out, int n);
+
+#endif
@@ -0,0 +1,103 @@
+/*-----------------------------------------------------------------------------------------
+
+	ESP-1 patch bank tool
+
+	Lists the patches of a bank, or writes a new bank of count patches made from the
+	default sound: the waveform goes through pulse, triangle, sawtooth and sine, and
+	the attack and release of the amplitude envelope grow from patch to patch, and every
+	other group of four patches has the filter on with a different cutoff and resonance. The
+	bank is a starting point to edit, and a test for large banks.
+
+	usage: esp1bank bank
+	       esp1bank -n count bank
+
+-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "synth.h"
+
+static const char *waveName[] = { "none", "pulse", "triangle", "sawtooth", "sine", "user" };
+
+static void usage()
+{
+	fprintf(stderr, "usage: esp1bank bank\n"
+	                "       esp1bank -n count bank\n");
+}
+
+/*-------------------------------------------------------------------------------------------
+  listBank
+---------------------------------------------------------------------------------------------*/
+static int listBank(const char *path)
+{
+	PatchBank *bank = openBank(path);
+	const Patch *p;
+	int i, w;
+
+	if (bank == NULL) {
+		fprintf(stderr, "Cannot open patch bank %s\n", path);
+		return 1;
+	}
+	for (i = 0; i < bank->count; i++) {
+		p = bankPatch(bank, i);
+		w = (p->waveform >= 0 && p->waveform <= NUM_WAVES) ? p->waveform : 0;
+		printf("%3d:%3d:%3d  %-*.*s %-8s A %4d D %4d S %3d R %4d",
+		       i / (128 * 128), i / 128 % 128, i % 128, PATCH_NAME, PATCH_NAME, p->name, waveName[w],
+		       p->env[ENV_AMP][ATT], p->env[ENV_AMP][DEC], p->env[ENV_AMP][SUS], p->env[ENV_AMP][REL]);
+		if (p->filter == FILTER_LP)
+			printf("  LP %5.1f Q %.2f", p->cutoff, p->resonance);
+		printf("\n");
+	}
+	closeBank(bank);
+	return 0;
+}
+
+/*-------------------------------------------------------------------------------------------
+  makeBank
+---------------------------------------------------------------------------------------------*/
+static int makeBank(const char *path, int count)
+{
+	Patch *patch = malloc(count * sizeof(Patch));
+	int i, err;
+
+	for (i = 0; i < count; i++) {
+		defaultPatch(&patch[i]);
+		snprintf(patch[i].name, PATCH_NAME, "Patch %d", i);
+		patch[i].waveform = PUL + i % 4;
+		patch[i].env[ENV_AMP][ATT] = (i / 4 * 10) % ATT_MAX;
+		patch[i].env[ENV_AMP][REL] = (100 + i / 4 * 50) % REL_MAX;
+		if (i / 4 % 2) {
+			patch[i].filter = FILTER_LP;
+			patch[i].cutoff = 40 + i * 7 % 60;
+			patch[i].resonance = i % 5 * 0.2;
+		}
+	}
+	err = writeBank(path, patch, count);
+	if (err)
+		fprintf(stderr, "Cannot write %s\n", path);
+	free(patch);
+	return err;
+}
+
+/*-------------------------------------------------------------------------------------------
+  main
+---------------------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	int opt, count = 0;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+			case 'n': count = atoi(optarg); break;
+			default: usage(); return 1;
+		}
+	}
+	if (argc - optind != 1 || count < 0 || count > 128 * 128 * 128) {
+		usage();
+		return 1;
+	}
+	if (count > 0)
+		return makeBank(argv[optind], count);
+	return listBank(argv[optind]);
+}
@@ -0,0 +1,67 @@
+/*-----------------------------------------------------------------------------------------
+
+	ESP-1 statistics reader
+
+	Prints the real-time statistics of a running ESP-1 from its shared memory segment:
+	callback timing against the deadline, device xruns, event queue depth, dropped midi
+	events and voice counts. The synth is not disturbed, the segment is only read.
+
+	usage: esp1stat [-i interval seconds] [-1]
+
+-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include "stats.h"
+
+static void usage()
+{
+	fprintf(stderr, "usage: esp1stat [-i interval seconds] [-1]\n");
+}
+
+/*-------------------------------------------------------------------------------------------
+  main
+---------------------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	int opt, once = 0;
+	double interval = 1.0;
+	struct timespec nap;
+	Stats *stats;
+
+	while ((opt = getopt(argc, argv, "i:1")) != -1) {
+		switch (opt) {
+			case 'i': interval = atof(optarg); break;
+			case '1': once = 1; break;
+			default: usage(); return 1;
+		}
+	}
+	if (interval < 0.01)
+		interval = 0.01;
+	nap.tv_sec = (time_t)interval;
+	nap.tv_nsec = (long)((interval - nap.tv_sec) * 1e9);
+
+	stats = statsAttach();
+	if (stats == NULL) {
+		fprintf(stderr, "ESP-1 is not running\n");
+		return 1;
+	}
+
+	for (;;) {
+		if (kill(stats->pid, 0) != 0) {
+			fprintf(stderr, "ESP-1 (pid %d) has exited\n", stats->pid);
+			break;
+		}
+		statsPrint(stats, stdout);
+		if (once)
+			break;
+		printf("\n");
+		fflush(stdout);
+		nanosleep(&nap, NULL);
+	}
+	statsDetach(stats);
+	return 0;
+}
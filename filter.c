@@ -0,0 +1,54 @@
+
+#include <math.h>
+#include "filter.h"
+
+/* highest cutoff, as a fraction of the samplerate, where the filter is still well-behaved */
+#define CUTOFF_NYQUIST 0.45
+
+static float warpTable[CUTOFF_MAX * CUTOFF_STEPS + 1];
+
+
+/* -------------------------------------------------------------------------------------
+	filterInit: g = tan(pi * f / samplerate) for every step of the cutoff
+------------------------------------------------------------------------------------- */
+void filterInit(float samplerate)
+{
+	double f;
+	int i;
+
+	for (i = 0; i <= CUTOFF_MAX * CUTOFF_STEPS; i++) {
+		f = 440 * pow(2, (i / (double)CUTOFF_STEPS - 69) / 12);
+		if (f > CUTOFF_NYQUIST * samplerate)
+			f = CUTOFF_NYQUIST * samplerate;
+		warpTable[i] = tan(M_PI * f / samplerate);
+	}
+}
+
+void filterReset(FilterState *f)
+{
+	f->ic1 = f->ic2 = 0;
+	f->step = -1;
+	f->res = -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	filterCoefs: the damping k goes from 2 (no resonance) down to 0.05
+------------------------------------------------------------------------------------- */
+void filterCoefs(FilterState *f, float cutoff, float res)
+{
+	int step = cutoff * CUTOFF_STEPS + 0.5f;
+	float g, k;
+
+	if (step < 0) step = 0;
+	if (step > CUTOFF_MAX * CUTOFF_STEPS) step = CUTOFF_MAX * CUTOFF_STEPS;
+	if (step == f->step && res == f->res)
+		return;
+
+	g = warpTable[step];
+	k = 2 - 1.95f * res;
+	f->a1 = 1 / (1 + g * (g + k));
+	f->a2 = g * f->a1;
+	f->a3 = g * f->a2;
+	f->step = step;
+	f->res = res;
+}
@@ -0,0 +1,64 @@
+
+/*-----------------------------------------------------------------------------------
+    FILTER
+
+    Resonant low-pass filter of the voices: a two-pole state variable filter in
+	the trapezoidal (zero delay feedback) form, which stays stable and in tune up
+	to high cutoff frequencies and resonances.
+
+	-the cutoff is given in semitones on the midi note scale (69 is 440 Hz). The
+	 frequency warping tan(pi * f / samplerate) is read from a table made at
+	 startup, in steps of 1/16 semitone
+	-the coefficients of a voice are cached with the table step and resonance
+	 they were computed for, and computed again only when those change
+	-the coefficients are updated every FILTER_CHUNK samples. The voices are
+	 filtered FILTER_LANES at a time by the filter kernel of dsp.h, one voice
+	 in each vector lane, so the recursion of the filter runs across voices
+	 instead of across samples
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#define FILTER_OFF 0
+#define FILTER_LP  1
+
+/* voices filtered at once, and samples between coefficient updates */
+#define FILTER_LANES 8
+#define FILTER_CHUNK 32
+
+/* coefficients per chunk: a1, a2, a3 of each lane */
+#define FILTER_COEFS 3
+
+/* cutoff range and table resolution, semitones */
+#define CUTOFF_MAX   150
+#define CUTOFF_STEPS 16
+
+/* state and cached coefficients of one voice */
+typedef struct
+{
+	float ic1, ic2;     /* integrator states */
+	int   step;         /* table step the coefficients are for, -1 if none */
+	float res;          /* resonance they are for */
+	float a1, a2, a3;
+} FilterState;
+
+
+/*---------------------------------------------------------------------------
+	filterInit makes the cutoff table for samplerate
+------------------------------------------------------------------------------*/
+void filterInit(float samplerate);
+
+/*---------------------------------------------------------------------------
+	filterReset clears the state of a voice
+------------------------------------------------------------------------------*/
+void filterReset(FilterState *f);
+
+/*---------------------------------------------------------------------------
+	filterCoefs updates the cached coefficients for cutoff (semitones) and
+	resonance (0-1)
+------------------------------------------------------------------------------*/
+void filterCoefs(FilterState *f, float cutoff, float res);
+
+#endif
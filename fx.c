@@ -0,0 +1,329 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fx.h"
+#include "ringbuf.h"
+
+/* longest delay time, seconds */
+#define DELAY_MAX 1.0
+
+/* chorus delay and its modulation depth, seconds */
+#define CHORUS_BASE  0.008
+#define CHORUS_DEPTH 0.002
+
+/* lengths of the reverb lines and diffusers, seconds. The lines are rounded up to
+   prime lengths in samples, so their echoes do not pile up */
+static const float reverbTimes[REVERB_LINES] = { 0.0297, 0.0371, 0.0411, 0.0437 };
+static const float diffTimes[REVERB_DIFFUSERS] = { 0.0071, 0.0113 };
+
+/* the feedback matrix of the network, a scaled Hadamard matrix, which keeps the energy */
+static const float hadamard[REVERB_LINES][REVERB_LINES] = {
+	{ 0.5,  0.5,  0.5,  0.5 },
+	{ 0.5, -0.5,  0.5, -0.5 },
+	{ 0.5,  0.5, -0.5, -0.5 },
+	{ 0.5, -0.5, -0.5,  0.5 }
+};
+
+
+/* -------------------------------------------------------------------------------------
+	delay lines: a line is long enough for its longest delay and one block more, so the
+	block that is read never overlaps the block that is written after it
+------------------------------------------------------------------------------------- */
+static int createLine(DelayLine *l, int maxDelay)
+{
+	unsigned int size = 1;
+
+	while (size < (unsigned int)maxDelay + DSP_BLOCK + 2)
+		size <<= 1;
+	if (posix_memalign((void**)&l->buf, CACHE_LINE, size * sizeof(float)) != 0) {
+		l->buf = NULL;
+		return 1;
+	}
+	memset(l->buf, 0, size * sizeof(float));
+	l->mask = size - 1;
+	l->pos = 0;
+	return 0;
+}
+
+/* n samples from delay samples ago, in at most two pieces */
+static void lineRead(const DelayLine *l, int delay, float *out, int n)
+{
+	unsigned int start = (l->pos - delay) & l->mask, first = l->mask + 1 - start;
+
+	if (first >= (unsigned int)n)
+		memcpy(out, l->buf + start, n * sizeof(float));
+	else {
+		memcpy(out, l->buf + start, first * sizeof(float));
+		memcpy(out + first, l->buf, (n - first) * sizeof(float));
+	}
+}
+
+static void lineWrite(DelayLine *l, const float *in, int n)
+{
+	unsigned int first = l->mask + 1 - l->pos;
+
+	if (first >= (unsigned int)n)
+		memcpy(l->buf + l->pos, in, n * sizeof(float));
+	else {
+		memcpy(l->buf + l->pos, in, first * sizeof(float));
+		memcpy(l->buf, in + first, (n - first) * sizeof(float));
+	}
+	l->pos = (l->pos + n) & l->mask;
+}
+
+/* a delay in samples, at least one block */
+static int blockDelay(float seconds, float samplerate)
+{
+	int d = seconds * samplerate + 0.5f;
+	return (d > DSP_BLOCK) ? d : DSP_BLOCK;
+}
+
+/* the smallest prime that is at least n */
+static int nextPrime(int n)
+{
+	int d;
+
+	for (;; n++) {
+		for (d = 2; d * d <= n && n % d != 0; d++)
+			;
+		if (n > 1 && d * d > n)
+			return n;
+	}
+}
+
+
+/* -------------------------------------------------------------------------------------
+	createFxBus
+------------------------------------------------------------------------------------- */
+FxBus *createFxBus(float samplerate)
+{
+	FxBus *fx = calloc(1, sizeof(FxBus));
+	int i, err = 0;
+
+	if (fx == NULL)
+		return NULL;
+	fx->samplerate = samplerate;
+
+	for (i = 0; i < 2; i++)
+		err |= createLine(&fx->delay[i], blockDelay(DELAY_MAX, samplerate));
+	err |= createLine(&fx->chorus, (CHORUS_BASE + CHORUS_DEPTH) * samplerate + 2);
+	for (i = 0; i < REVERB_DIFFUSERS; i++) {
+		fx->diffTime[i] = blockDelay(diffTimes[i], samplerate);
+		err |= createLine(&fx->diffuser[i], fx->diffTime[i]);
+	}
+	for (i = 0; i < REVERB_LINES; i++) {
+		fx->lineTime[i] = nextPrime(blockDelay(reverbTimes[i], samplerate));
+		if (i > 0 && fx->lineTime[i] <= fx->lineTime[i - 1])
+			fx->lineTime[i] = nextPrime(fx->lineTime[i - 1] + 1);
+		err |= createLine(&fx->line[i], fx->lineTime[i] + 1);
+	}
+	for (i = 0; i < FX_TMP; i++) {
+		if (posix_memalign((void**)&fx->tmp[i], CACHE_LINE, DSP_BLOCK * sizeof(float)) != 0) {
+			fx->tmp[i] = NULL;
+			err = 1;
+		}
+	}
+	if (err) {
+		destroyFxBus(fx);
+		return NULL;
+	}
+
+	fx->chorusPhase = 0;
+	fx->chorusRate = 0.4;
+	fx->chorusBase = CHORUS_BASE * samplerate;
+	fx->chorusDepth = CHORUS_DEPTH * samplerate;
+	fx->diffGain = 0.6;
+
+	fx->level[FX_DELAY] = 0.7;
+	fx->level[FX_CHORUS] = 0.8;
+	fx->level[FX_REVERB] = 0.35;
+	fx->tail[FX_CHORUS] = fx->chorusBase + fx->chorusDepth + DSP_BLOCK;
+	for (i = 0; i < NUM_FX; i++)
+		fx->left[i] = 0;
+	fxSetDelay(fx, 0.3, 0.45, 0.4);
+	fxSetReverb(fx, 2.0, 0.3);
+	return fx;
+}
+
+void destroyFxBus(FxBus *fx)
+{
+	int i;
+
+	if (fx == NULL)
+		return;
+	for (i = 0; i < 2; i++)
+		free(fx->delay[i].buf);
+	free(fx->chorus.buf);
+	for (i = 0; i < REVERB_DIFFUSERS; i++)
+		free(fx->diffuser[i].buf);
+	for (i = 0; i < REVERB_LINES; i++)
+		free(fx->line[i].buf);
+	for (i = 0; i < FX_TMP; i++)
+		free(fx->tmp[i]);
+	free(fx);
+}
+
+/* -------------------------------------------------------------------------------------
+	fxSetReverb: each line loses 60 dB over decay seconds. The tail lasts until the
+	reverb is down by 90 dB.
+------------------------------------------------------------------------------------- */
+void fxSetReverb(FxBus *fx, float decay, float damp)
+{
+	int i;
+
+	if (decay < 0.1f) decay = 0.1f;
+	if (decay > 20) decay = 20;
+	for (i = 0; i < REVERB_LINES; i++)
+		fx->lineGain[i] = powf(10, -3.0f * fx->lineTime[i] / (decay * fx->samplerate));
+	fx->damp = (damp < 0) ? 0 : (damp > 0.5f) ? 0.5f : damp;
+	fx->tail[FX_REVERB] = 1.5f * decay * fx->samplerate;
+}
+
+/* -------------------------------------------------------------------------------------
+	fxSetDelay: the tail lasts until the echoes are down by 60 dB
+------------------------------------------------------------------------------------- */
+void fxSetDelay(FxBus *fx, float left, float right, float feedback)
+{
+	int i, longest;
+
+	fx->delayTime[0] = blockDelay(left < DELAY_MAX ? left : DELAY_MAX, fx->samplerate);
+	fx->delayTime[1] = blockDelay(right < DELAY_MAX ? right : DELAY_MAX, fx->samplerate);
+	if (feedback < 0) feedback = 0;
+	if (feedback > 0.95f) feedback = 0.95f;
+	fx->feedback = feedback;
+
+	longest = (fx->delayTime[0] > fx->delayTime[1]) ? fx->delayTime[0] : fx->delayTime[1];
+	i = (feedback > 0.001f) ? logf(0.001f) / logf(feedback) + 1 : 1;
+	fx->tail[FX_DELAY] = (i + 1) * longest;
+}
+
+int fxActive(const FxBus *fx)
+{
+	int e, mask = 0;
+
+	for (e = 0; e < NUM_FX; e++) {
+		if (fx->left[e] > 0)
+			mask |= 1 << e;
+	}
+	return mask;
+}
+
+
+/* -------------------------------------------------------------------------------------
+	processDelay: the left line is fed by the input and the right line, the right line
+	by the left one
+------------------------------------------------------------------------------------- */
+static void processDelay(FxBus *fx, const float *in, float *left, float *right, int n)
+{
+	float *a = fx->tmp[0], *b = fx->tmp[1], *w = fx->tmp[2];
+
+	lineRead(&fx->delay[0], fx->delayTime[0], a, n);
+	lineRead(&fx->delay[1], fx->delayTime[1], b, n);
+
+	memcpy(w, in, n * sizeof(float));
+	dsp.addScaled(w, b, fx->feedback, n);
+	lineWrite(&fx->delay[0], w, n);
+	dsp.clear(w, n);
+	dsp.addScaled(w, a, fx->feedback, n);
+	lineWrite(&fx->delay[1], w, n);
+
+	dsp.addScaled(left, a, fx->level[FX_DELAY], n);
+	dsp.addScaled(right, b, fx->level[FX_DELAY], n);
+}
+
+/* -------------------------------------------------------------------------------------
+	processChorus: the block is written first, as the chorus delay can be shorter than a
+	block. The two taps move in quadrature, and their delay moves linearly over the block.
+------------------------------------------------------------------------------------- */
+static void processChorus(FxBus *fx, const float *in, float *left, float *right, int n)
+{
+	DelayLine *l = &fx->chorus;
+	float *buf = l->buf, phase = fx->chorusPhase, next, x, frac, d0[2], d1[2], *out[2], s;
+	float level = fx->level[FX_CHORUS];
+	unsigned int start = l->pos, mask = l->mask, k;
+	int i, t;
+
+	lineWrite(l, in, n);
+	next = phase + fx->chorusRate * n / fx->samplerate;
+	for (t = 0; t < 2; t++) {
+		d0[t] = fx->chorusBase + fx->chorusDepth * sinf(2 * M_PI * (phase + 0.25f * t));
+		d1[t] = fx->chorusBase + fx->chorusDepth * sinf(2 * M_PI * (next + 0.25f * t));
+	}
+	fx->chorusPhase = next - floorf(next);
+
+	out[0] = left;
+	out[1] = right;
+	for (t = 0; t < 2; t++) {
+		for (i = 0; i < n; i++) {
+			x = start + i - (d0[t] + (d1[t] - d0[t]) * i / n) + (mask + 1);
+			k = (unsigned int)x;
+			frac = x - k;
+			s = buf[k & mask];
+			out[t][i] += level * (s + frac * (buf[(k + 1) & mask] - s));
+		}
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	processReverb: the input goes through two allpass diffusers into the network. The
+	lines are read at their length and one sample more, and the two are mixed for the
+	damping. Each line is fed by the input and a Hadamard mix of all line outputs.
+------------------------------------------------------------------------------------- */
+static void processReverb(FxBus *fx, const float *in, float *left, float *right, int n)
+{
+	float **y = fx->tmp, *x = fx->tmp[REVERB_LINES], *t = fx->tmp[REVERB_LINES + 1],
+	      *w = fx->tmp[REVERB_LINES + 2], g = fx->diffGain;
+	int i, j;
+
+	/* allpass: out = delayed - g * in, the line takes in + g * out */
+	memcpy(x, in, n * sizeof(float));
+	for (i = 0; i < REVERB_DIFFUSERS; i++) {
+		lineRead(&fx->diffuser[i], fx->diffTime[i], t, n);
+		dsp.addScaled(t, x, -g, n);
+		dsp.addScaled(x, t, g, n);
+		lineWrite(&fx->diffuser[i], x, n);
+		memcpy(x, t, n * sizeof(float));
+	}
+
+	for (i = 0; i < REVERB_LINES; i++) {
+		lineRead(&fx->line[i], fx->lineTime[i], w, n);
+		dsp.clear(y[i], n);
+		dsp.addScaled(y[i], w, 1 - fx->damp, n);
+		lineRead(&fx->line[i], fx->lineTime[i] + 1, w, n);
+		dsp.addScaled(y[i], w, fx->damp, n);
+	}
+	for (i = 0; i < REVERB_LINES; i++) {
+		memcpy(w, x, n * sizeof(float));
+		for (j = 0; j < REVERB_LINES; j++)
+			dsp.addScaled(w, y[j], fx->lineGain[i] * hadamard[i][j], n);
+		lineWrite(&fx->line[i], w, n);
+	}
+
+	dsp.addScaled(left, y[0], fx->level[FX_REVERB], n);
+	dsp.addScaled(left, y[2], fx->level[FX_REVERB], n);
+	dsp.addScaled(right, y[1], fx->level[FX_REVERB], n);
+	dsp.addScaled(right, y[3], fx->level[FX_REVERB], n);
+}
+
+/* -------------------------------------------------------------------------------------
+	fxProcess
+------------------------------------------------------------------------------------- */
+void fxProcess(FxBus *fx, float **send, int mask, int inputs, float *left, float *right, int n)
+{
+	int e;
+
+	if (mask & (1 << FX_DELAY))
+		processDelay(fx, send[FX_DELAY], left, right, n);
+	if (mask & (1 << FX_CHORUS))
+		processChorus(fx, send[FX_CHORUS], left, right, n);
+	if (mask & (1 << FX_REVERB))
+		processReverb(fx, send[FX_REVERB], left, right, n);
+
+	for (e = 0; e < NUM_FX; e++) {
+		if (inputs & (1 << e))
+			fx->left[e] = fx->tail[e];
+		else if (mask & (1 << e))
+			fx->left[e] = (fx->left[e] > n) ? fx->left[e] - n : 0;
+	}
+}
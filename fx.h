@@ -0,0 +1,105 @@
+
+/*-----------------------------------------------------------------------------------
+    FX
+
+    Master effects bus: stereo delay, chorus and reverb. Each part sends some of
+	its voices to each effect, the sends are summed into one mono bus per effect,
+	and the effects process the buses once per block. Their stereo output is added
+	to the dry mix.
+
+	-all delay memory is reserved when the bus is created, nothing is allocated
+	 while the audio is running
+	-the delay and reverb lines are never shorter than DSP_BLOCK, so a whole
+	 block can be read from a line before it is written, and the lines are
+	 processed with the block kernels of dsp.h instead of sample by sample.
+	 The reverb is a feedback delay network of four lines; its damping is a
+	 two-tap filter on the line outputs, so it needs no recursion either
+	-the chorus reads its lines at a moving fractional position, which is done
+	 sample by sample
+	-an effect is processed only while something is sent to it, and after that
+	 until its tail has died out
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef FX_H
+#define FX_H
+
+#include "dsp.h"
+
+#define FX_DELAY  0
+#define FX_CHORUS 1
+#define FX_REVERB 2
+#define NUM_FX    3
+
+#define REVERB_LINES 4
+#define REVERB_DIFFUSERS 2
+
+/* block buffers used by the effects */
+#define FX_TMP (REVERB_LINES + 3)
+
+/* a circular delay line, the size is a power of two */
+typedef struct
+{
+	float *buf;
+	unsigned int mask;
+	unsigned int pos;     /* next position to write */
+} DelayLine;
+
+typedef struct
+{
+	float samplerate;
+	int   tail[NUM_FX];       /* frames to process after the last input */
+	int   left[NUM_FX];       /* frames of tail left */
+	float level[NUM_FX];      /* return levels into the mix */
+
+	/* delay: the lines feed each other, so the echoes go from side to side */
+	DelayLine delay[2];
+	int   delayTime[2];
+	float feedback;
+
+	/* chorus: one line, read at two positions that move with a slow lfo */
+	DelayLine chorus;
+	float chorusPhase, chorusRate, chorusBase, chorusDepth;  /* cycles, Hz, samples, samples */
+
+	/* reverb: input diffusers and the network */
+	DelayLine diffuser[REVERB_DIFFUSERS];
+	int   diffTime[REVERB_DIFFUSERS];
+	float diffGain;
+	DelayLine line[REVERB_LINES];
+	int   lineTime[REVERB_LINES];
+	float lineGain[REVERB_LINES];  /* feedback gain of each line for the decay time */
+	float damp;
+
+	float *tmp[FX_TMP];
+} FxBus;
+
+
+/*---------------------------------------------------------------------------
+	createFxBus reserves all lines and buffers for samplerate
+------------------------------------------------------------------------------*/
+FxBus *createFxBus(float samplerate);
+
+void destroyFxBus(FxBus *fx);
+
+/*---------------------------------------------------------------------------
+	fxSetReverb sets the decay time (seconds to -60 dB) and the damping (0-1)
+	of the reverb. fxSetDelay sets the delay times (seconds, at most 1) and
+	the feedback (0-0.95). Called between blocks.
+------------------------------------------------------------------------------*/
+void fxSetReverb(FxBus *fx, float decay, float damp);
+void fxSetDelay(FxBus *fx, float left, float right, float feedback);
+
+/*---------------------------------------------------------------------------
+	fxActive returns a bit (1 << FX_*) for each effect that still has a tail
+	to process, even with no new input
+------------------------------------------------------------------------------*/
+int fxActive(const FxBus *fx);
+
+/*---------------------------------------------------------------------------
+	fxProcess runs the effects in mask over n <= DSP_BLOCK frames of their
+	send buses and adds the output into left and right. inputs has the bits of
+	the buses that got something in this block, the others must be silent.
+------------------------------------------------------------------------------*/
+void fxProcess(FxBus *fx, float **send, int mask, int inputs, float *left, float *right, int n);
+
+#endif
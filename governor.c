@@ -0,0 +1,101 @@
+
+#include <stdlib.h>
+#include "governor.h"
+
+
+/* -------------------------------------------------------------------------------------
+	createGovernor
+------------------------------------------------------------------------------------- */
+Governor *createGovernor(int levels, double samplerate)
+{
+	Governor *g = malloc(sizeof(Governor));
+
+	g->levels = (levels > 1) ? levels : 1;
+	g->level = 0;
+	g->avg = 0;
+	g->samplerate = samplerate;
+	g->frames = 0;
+	g->settle = 0;
+	g->lowSince = 0;
+	g->lastDown = 0;
+	g->recover = GOV_RECOVER * samplerate;
+	g->log = createRingBuffer(GOV_LOG, sizeof(GovDecision));
+	return g;
+}
+
+void destroyGovernor(Governor *g)
+{
+	if (g == NULL)
+		return;
+	destroyRingBuffer(g->log);
+	free(g);
+}
+
+/* -------------------------------------------------------------------------------------
+	decide: the decision is logged, and the timers are started again
+------------------------------------------------------------------------------------- */
+static int decide(Governor *g, int to, double load)
+{
+	GovDecision d;
+
+	d.time = g->frames / g->samplerate;
+	d.from = g->level;
+	d.to = to;
+	d.load = load;
+	d.avg = g->avg;
+	ringWrite(g->log, &d, 1);
+
+	if (to >= g->level) {
+		/* raised soon after a step down: the step was too early */
+		if (g->lastDown > 0 && g->frames - g->lastDown < g->recover
+		    && g->recover < GOV_BACKOFF * GOV_RECOVER * g->samplerate)
+			g->recover *= 2;
+		g->settle = g->frames + (unsigned long long)(GOV_SETTLE * g->samplerate);
+	}
+	else
+		g->lastDown = g->frames;
+	g->lowSince = g->frames;
+	g->level = to;
+	return to;
+}
+
+/* -------------------------------------------------------------------------------------
+	govUpdate
+------------------------------------------------------------------------------------- */
+int govUpdate(Governor *g, double load, unsigned long frames)
+{
+	int top = g->levels - 1;
+
+	g->frames += frames;
+	g->avg += (load - g->avg) * GOV_SMOOTH;
+
+	if (g->avg > GOV_HIGH || load > GOV_PANIC) {
+		/* a block close to its deadline does not wait for the previous raise to settle,
+		   but more voices are shed only after it */
+		if (g->level < top && (load > GOV_PANIC || g->frames >= g->settle))
+			return decide(g, g->level + 1, load);
+		if (g->level == top && g->frames >= g->settle)
+			return decide(g, top, load);
+		g->lowSince = g->frames;
+	}
+	else if (g->avg < GOV_LOW && g->level > 0) {
+		if (g->frames - g->lowSince >= g->recover)
+			return decide(g, g->level - 1, load);
+	}
+	else
+		g->lowSince = g->frames;
+	return -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	govDecisions, govLost
+------------------------------------------------------------------------------------- */
+int govDecisions(Governor *g, GovDecision *out, int max)
+{
+	return ringRead(g->log, out, max);
+}
+
+unsigned long govLost(Governor *g)
+{
+	return ringOverflow(g->log);
+}
@@ -0,0 +1,96 @@
+
+/*-----------------------------------------------------------------------------------
+    GOVERNOR
+
+    Watches the load of the audio thread, the render time of each block as a
+	fraction of its deadline, and decides on a quality level, so that the synth
+	sheds work before it misses deadlines instead of dropping out. Level 0 is
+	full quality, each higher level does less work; what a level means is up
+	to the caller (see setQuality in synth.h).
+
+	-the load is smoothed, and the level is raised when the smoothed load is
+	 high, at once when a single block comes close to its deadline. After a
+	 raise the governor waits for the effect before raising again
+	-the level is lowered one step at a time, only after the load has stayed
+	 low for a while, so quality does not flap between two levels. If the
+	 level has to be raised again soon after a step down, the wait before the
+	 next step down is doubled
+	-at the highest level, further overload is reported as a new decision at
+	 the same level, so the caller can shed more
+	-every decision is written into a queue with the load that caused it. The
+	 queue is read by another thread, for the log and post-mortem analysis
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "ringbuf.h"
+
+/* smoothed load that raises the level, and that lets it be lowered */
+#define GOV_HIGH 0.70
+#define GOV_LOW  0.35
+
+/* load of a single block that raises the level at once */
+#define GOV_PANIC 0.90
+
+/* weight of the newest block in the smoothed load */
+#define GOV_SMOOTH 0.1
+
+/* seconds to wait after a raise, and seconds of low load before a step down,
+   which can grow up to GOV_BACKOFF times */
+#define GOV_SETTLE  0.1
+#define GOV_RECOVER 2.0
+#define GOV_BACKOFF 8
+
+/* decisions kept until they are read */
+#define GOV_LOG 1024
+
+/* one decision */
+typedef struct
+{
+	double time;        /* seconds of audio rendered when the decision was made */
+	int    from, to;    /* quality levels */
+	float  load;        /* load of the block */
+	float  avg;         /* smoothed load */
+} GovDecision;
+
+typedef struct
+{
+	int    levels;
+	int    level;
+	float  avg;
+	double samplerate;
+	unsigned long long frames;   /* frames rendered */
+	unsigned long long settle;   /* no raise before this frame */
+	unsigned long long lowSince; /* frame where the load went low */
+	unsigned long long lastDown; /* frame of the last step down */
+	unsigned long long recover;  /* frames of low load needed for a step down */
+	RingBuffer *log;
+} Governor;
+
+
+/*---------------------------------------------------------------------------
+	createGovernor returns a governor for levels quality levels, starting
+	at full quality (0)
+------------------------------------------------------------------------------*/
+Governor *createGovernor(int levels, double samplerate);
+
+void destroyGovernor(Governor *g);
+
+/*---------------------------------------------------------------------------
+	govUpdate is called by the audio thread after each block of frames, with
+	its render time as a fraction of the deadline. Returns the level to use
+	when a decision was made, otherwise -1.
+------------------------------------------------------------------------------*/
+int govUpdate(Governor *g, double load, unsigned long frames);
+
+/*---------------------------------------------------------------------------
+	govDecisions reads up to max decisions from the log, oldest first, and
+	returns the number read. govLost tells how many did not fit into the log.
+	Called by one reading thread only.
+------------------------------------------------------------------------------*/
+int govDecisions(Governor *g, GovDecision *out, int max);
+unsigned long govLost(Governor *g);
+
+#endif
@@ -0,0 +1,225 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midifile.h"
+
+/* an event as it is read from a track, before the tempo map is applied */
+typedef struct
+{
+	unsigned long tick;
+	long order;      /* position in the file, keeps simultaneous events in order */
+	long tempo;      /* microseconds per quarter note for tempo events, otherwise -1 */
+	PmMessage msg;
+} RawEvent;
+
+typedef struct
+{
+	RawEvent *ev;
+	long count;
+	long reserved;
+} RawList;
+
+
+/* -------------------------------------------------------------------------------------
+	readBig: big endian integer of n bytes
+------------------------------------------------------------------------------------- */
+static unsigned long readBig(const unsigned char *p, int n)
+{
+	unsigned long v = 0;
+	while (n-- > 0)
+		v = (v << 8) | *p++;
+	return v;
+}
+
+/* -------------------------------------------------------------------------------------
+	readVar: variable length quantity. Returns -1 if it runs past end.
+------------------------------------------------------------------------------------- */
+static long readVar(const unsigned char **p, const unsigned char *end)
+{
+	long v = 0;
+	int i;
+
+	for (i = 0; i < 4 && *p < end; i++) {
+		v = (v << 7) | (**p & 0x7F);
+		if (!(*(*p)++ & 0x80))
+			return v;
+	}
+	return -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	addRaw
+------------------------------------------------------------------------------------- */
+static void addRaw(RawList *list, unsigned long tick, long tempo, PmMessage msg)
+{
+	if (list->count == list->reserved) {
+		list->reserved = list->reserved ? list->reserved * 2 : 1024;
+		list->ev = realloc(list->ev, list->reserved * sizeof(RawEvent));
+	}
+	list->ev[list->count].tick = tick;
+	list->ev[list->count].order = list->count;
+	list->ev[list->count].tempo = tempo;
+	list->ev[list->count].msg = msg;
+	list->count++;
+}
+
+/* -------------------------------------------------------------------------------------
+	compareRaw: order by tick, then by position in the file
+------------------------------------------------------------------------------------- */
+static int compareRaw(const void *a, const void *b)
+{
+	const RawEvent *x = a, *y = b;
+	if (x->tick != y->tick)
+		return (x->tick < y->tick) ? -1 : 1;
+	return (x->order < y->order) ? -1 : (x->order > y->order);
+}
+
+/* -------------------------------------------------------------------------------------
+	parseTrack: the channel messages and tempo changes of one MTrk chunk are added
+	to the list. Returns 0 on success.
+------------------------------------------------------------------------------------- */
+static int parseTrack(const unsigned char *p, const unsigned char *end, RawList *list)
+{
+	unsigned long tick = 0;
+	unsigned char status = 0, type, d1, d2;
+	long delta, len;
+
+	while (p < end) {
+		delta = readVar(&p, end);
+		if (delta < 0 || p >= end)
+			return 1;
+		tick += delta;
+
+		/* running status: the status byte is left out if it is the same as before */
+		if (*p & 0x80)
+			status = *p++;
+		else if (status == 0)
+			return 1;
+
+		if (status == 0xFF) {                       /* meta event */
+			if (p >= end)
+				return 1;
+			type = *p++;
+			len = readVar(&p, end);
+			if (len < 0 || p + len > end)
+				return 1;
+			if (type == 0x51 && len == 3)           /* tempo */
+				addRaw(list, tick, readBig(p, 3), 0);
+			else if (type == 0x2F)                  /* end of track */
+				return 0;
+			p += len;
+			status = 0;
+		}
+		else if (status == 0xF0 || status == 0xF7) { /* system exclusive */
+			len = readVar(&p, end);
+			if (len < 0 || p + len > end)
+				return 1;
+			p += len;
+			status = 0;
+		}
+		else {                                      /* channel message */
+			if (p >= end)
+				return 1;
+			d1 = *p++;
+			d2 = 0;
+			/* program change and channel pressure have only one data byte */
+			if ((status & 0xF0) != 0xC0 && (status & 0xF0) != 0xD0) {
+				if (p >= end)
+					return 1;
+				d2 = *p++;
+			}
+			addRaw(list, tick, -1, Pm_Message(status, d1, d2));
+		}
+	}
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	readMidiFile
+------------------------------------------------------------------------------------- */
+MidiFile *readMidiFile(const char *filename)
+{
+	FILE *f;
+	unsigned char *data, *p, *end;
+	long size, len, i;
+	int ntracks, division, track = 0;
+	double secsPerTick, time = 0;
+	unsigned long lastTick = 0;
+	RawList list = { NULL, 0, 0 };
+	MidiFile *mf;
+
+	f = fopen(filename, "rb");
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size > 0 ? size : 1);
+	if (size < 14 || fread(data, 1, size, f) != (size_t)size || memcmp(data, "MThd", 4) != 0) {
+		fclose(f);
+		free(data);
+		return NULL;
+	}
+	fclose(f);
+
+	len = readBig(data + 4, 4);
+	ntracks = readBig(data + 10, 2);
+	division = readBig(data + 12, 2);
+	p = data + 8 + len;
+	end = data + size;
+
+	while (track < ntracks && p + 8 <= end) {
+		len = readBig(p + 4, 4);
+		if (p + 8 + len > end)
+			len = end - p - 8;
+		if (memcmp(p, "MTrk", 4) == 0) {
+			if (parseTrack(p + 8, p + 8 + len, &list) != 0)
+				fprintf(stderr, "midifile: track %d is broken, read until the error\n", track);
+			track++;
+		}
+		p += 8 + len;
+	}
+	free(data);
+
+	/* tracks are merged by sorting all events by time */
+	qsort(list.ev, list.count, sizeof(RawEvent), compareRaw);
+
+	/* the tick length depends on the tempo, default 120 bpm. SMPTE division has a fixed
+	   tick length: frames per second in the high byte, ticks per frame in the low byte */
+	if (division & 0x8000)
+		secsPerTick = 1.0 / ((256 - (division >> 8)) * (division & 0xFF));
+	else
+		secsPerTick = 0.5 / (division ? division : 96);
+
+	mf = malloc(sizeof(MidiFile));
+	mf->events = malloc((list.count > 0 ? list.count : 1) * sizeof(MidiFileEvent));
+	mf->count = 0;
+	for (i = 0; i < list.count; i++) {
+		time += (list.ev[i].tick - lastTick) * secsPerTick;
+		lastTick = list.ev[i].tick;
+		if (list.ev[i].tempo >= 0) {
+			if (!(division & 0x8000))
+				secsPerTick = list.ev[i].tempo * 1e-6 / (division ? division : 96);
+			continue;
+		}
+		mf->events[mf->count].time = time;
+		mf->events[mf->count].ev.message = list.ev[i].msg;
+		mf->events[mf->count].ev.timestamp = (PmTimestamp)(time * 1000);
+		mf->count++;
+	}
+	mf->length = time;
+	free(list.ev);
+	return mf;
+}
+
+/* -------------------------------------------------------------------------------------
+	freeMidiFile
+------------------------------------------------------------------------------------- */
+void freeMidiFile(MidiFile *mf)
+{
+	if (mf == NULL)
+		return;
+	free(mf->events);
+	free(mf);
+}
@@ -0,0 +1,44 @@
+
+/*-----------------------------------------------------------------------------------
+    MIDIFILE
+
+    Reader for Standard MIDI Files (format 0 and 1). All channel messages of all
+	tracks are merged into one list of events in time order. The tempo map is
+	applied, so each event gets its time in seconds.
+
+	-system exclusive and meta events other than tempo are skipped
+	-the PmEvent timestamp of each event is its time in milliseconds
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef MIDIFILE_H
+#define MIDIFILE_H
+
+#include <portmidi.h>
+
+typedef struct
+{
+	double  time;   /* seconds from the start of the file */
+	PmEvent ev;
+} MidiFileEvent;
+
+typedef struct
+{
+	MidiFileEvent *events;
+	int count;
+	double length;  /* time of the last event, seconds */
+} MidiFile;
+
+
+/*---------------------------------------------------------------------------
+	readMidiFile reads and parses a file. Returns NULL if the file cannot be
+	read or is not a midi file.
+------------------------------------------------------------------------------*/
+MidiFile *readMidiFile(const char *filename);
+
+/*---------------------------------------------------------------------------
+	freeMidiFile
+------------------------------------------------------------------------------*/
+void freeMidiFile(MidiFile *mf);
+
+#endif
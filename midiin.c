@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fnmatch.h>
+#include "midiin.h"
+#include "synth.h"
+
+/* message kinds, bit (status >> 4) - 8 of the drop mask */
+#define DROP_NOTES    (1 << 0 | 1 << 1 | 1 << 2)
+#define DROP_CONTROL  (1 << 3)
+#define DROP_PROGRAM  (1 << 4)
+#define DROP_PRESSURE (1 << 2 | 1 << 5)
+#define DROP_BEND     (1 << 6)
+
+
+/* -------------------------------------------------------------------------------------
+	findDevice: the first midi input whose name is the pattern, or matches it as a shell
+	wildcard pattern, and that no other source has open. Returns -1 if there is none.
+------------------------------------------------------------------------------------- */
+static int findDevice(const char *pattern)
+{
+	const PmDeviceInfo *info;
+	int i;
+
+	for (i = 0; i < Pm_CountDevices(); i++) {
+		info = Pm_GetDeviceInfo(i);
+		if (info != NULL && info->input && !info->opened
+		    && (strcmp(info->name, pattern) == 0 || fnmatch(pattern, info->name, 0) == 0))
+			return i;
+	}
+	return -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	attachPorts: the missing ports are looked for and opened. If restart is set, PortMidi
+	is started again first so that its list of devices is read again; only when no port
+	is open. Returns the number of ports still missing.
+------------------------------------------------------------------------------------- */
+static int attachPorts(MidiInput *m, int restart)
+{
+	MidiSource *src;
+	int i, dev, missing = 0;
+
+	if (restart) {
+		Pm_Terminate();
+		Pm_Initialize();
+	}
+	for (i = 0; i < m->numSources; i++) {
+		src = &m->source[i];
+		if (src->type != SOURCE_PORT || src->open)
+			continue;
+		dev = findDevice(src->name);
+		if (dev < 0 || Pm_OpenInput(&src->port, dev, NULL, 512, NULL, 0) != 0) {
+			missing++;
+			continue;
+		}
+		src->open = 1;
+		printf("Midi input: %s\n", Pm_GetDeviceInfo(dev)->name);
+	}
+	return missing;
+}
+
+/* -------------------------------------------------------------------------------------
+	detachPort: the port has gone. The notes on the channels it plays are turned off
+	through the event queue, so that nothing is left sounding when the device is
+	unplugged mid-note.
+------------------------------------------------------------------------------------- */
+static void detachPort(MidiInput *m, MidiSource *src)
+{
+	PmEvent off;
+	int chan;
+
+	Pm_Close(src->port);
+	src->open = 0;
+	off.timestamp = Pt_Time();
+	for (chan = 0; chan < NUM_PARTS; chan++) {
+		if ((src->channel >= 0 && chan != src->channel) || (src->channel < 0 && src->only >= 0 && chan != src->only))
+			continue;
+		off.message = Pm_Message(CONTROL | chan, ALL_NOTES_OFF, 0);
+		ringWrite(m->queue, &off, 1);
+	}
+	printf("Midi input %s lost, waiting for it to come back.\n", src->name);
+}
+
+/* -------------------------------------------------------------------------------------
+	accept: the filters of the source are applied to an event, and its channel is moved.
+	System messages have no channel and pass as they are.
+------------------------------------------------------------------------------------- */
+static int accept(const MidiSource *src, PmEvent *ev)
+{
+	int status = Pm_MessageStatus(ev->message);
+
+	if (status >= 0xF0)
+		return 1;
+	if (src->drop & 1 << ((status >> 4) - 8))
+		return 0;
+	if (src->only >= 0 && (status & 0x0F) != src->only)
+		return 0;
+	if (src->channel >= 0)
+		ev->message = (ev->message & ~0x0F) | src->channel;
+	return 1;
+}
+
+/* -------------------------------------------------------------------------------------
+	readPort: one batch is read from the port into the batch of the source. Returns the
+	number of events read before filtering, so MIDI_BATCH means there may be more.
+------------------------------------------------------------------------------------- */
+static int readPort(MidiInput *m, MidiSource *src)
+{
+	int n, i;
+
+	n = Pm_Read(src->port, src->batch, MIDI_BATCH);
+	if (n < 0) {
+		/* the port's own buffer overflowed, the lost events cannot be counted */
+		if (n == pmBufferOverflow)
+			statsPortOverflow(m->stats);
+		else
+			detachPort(m, src);
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		if (accept(src, &src->batch[i]))
+			src->batch[src->count++] = src->batch[i];
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------
+	readFile: the events of the file that are due by now go into the batch of the source,
+	with their timestamps on the porttime clock. Returns the number of events taken.
+------------------------------------------------------------------------------------- */
+static int readFile(MidiSource *src, PtTimestamp now)
+{
+	MidiFile *f = src->file;
+	double at;
+	int n = 0;
+
+	while (n < MIDI_BATCH && src->next < f->count) {
+		at = src->start + 1000 * f->events[src->next].time;
+		if (at > now)
+			break;
+		src->batch[src->count] = f->events[src->next].ev;
+		src->batch[src->count].timestamp = (PtTimestamp)at;
+		if (accept(src, &src->batch[src->count]))
+			src->count++;
+		src->next++;
+		n++;
+		if (src->next == f->count && src->loop && f->length > 0) {
+			src->start += 1000 * f->length;
+			src->next = 0;
+		}
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------
+	merge: the batches of the sources are merged into one in timestamp order. Each batch
+	is in order already, so the earliest head is taken until all are used; at equal
+	times the source listed first goes first. Returns the number of events.
+------------------------------------------------------------------------------------- */
+static int merge(MidiInput *m)
+{
+	MidiSource *src, *first;
+	int i, n = 0;
+
+	for (;;) {
+		first = NULL;
+		for (i = 0; i < m->numSources; i++) {
+			src = &m->source[i];
+			if (src->pos < src->count
+			    && (first == NULL || src->batch[src->pos].timestamp < first->batch[first->pos].timestamp))
+				first = src;
+		}
+		if (first == NULL)
+			break;
+		m->merged[n++] = first->batch[first->pos++];
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------
+	pollMidi: thread function. Every round each source is read into its batch, and the
+	batches are merged and written into the event queue at once. Events that do not fit
+	into the queue are counted in the statistics. PortMidi has no blocking read, so when
+	no source had a full batch the thread sleeps briefly. While ports are missing, they
+	are looked for every MIDI_RESCAN_MS.
+------------------------------------------------------------------------------------- */
+static void *pollMidi(void *arg)
+{
+	MidiInput *m = (MidiInput *)arg;
+	MidiSource *src;
+	struct timespec idle = { 0, MIDI_IDLE_NS }, detached = { 0, MIDI_DETACHED_NS };
+	PtTimestamp now, scan = Pt_Time() + MIDI_RESCAN_MS;
+	int i, n, written, more, live, missing, open;
+
+	while (atomic_load_explicit(&m->running, memory_order_acquire)) {
+		now = Pt_Time();
+		more = live = missing = open = 0;
+		for (i = 0; i < m->numSources; i++) {
+			src = &m->source[i];
+			src->count = src->pos = 0;
+			if (src->type == SOURCE_FILE) {
+				more |= readFile(src, now) == MIDI_BATCH;
+				live |= src->next < src->file->count;
+			}
+			else if (src->open) {
+				more |= readPort(m, src) == MIDI_BATCH;
+				live |= src->open;
+			}
+			missing += src->type == SOURCE_PORT && !src->open;
+			open += src->type == SOURCE_PORT && src->open;
+		}
+
+		n = merge(m);
+		if (n > 0) {
+			written = ringWrite(m->queue, m->merged, n);
+			statsMidi(m->stats, n, n - written);
+		}
+
+		if (missing > 0 && now >= scan) {
+			attachPorts(m, open == 0);
+			scan = Pt_Time() + MIDI_RESCAN_MS;
+		}
+		if (!more)
+			nanosleep(live ? &idle : &detached, NULL);
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	channelOption: a channel 1-16 of an option, -1 if it is not one
+------------------------------------------------------------------------------------- */
+static int channelOption(const char *value)
+{
+	int ch = atoi(value);
+	return (ch >= 1 && ch <= NUM_PARTS) ? ch - 1 : -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	addSource: one source of the spec, its name and options separated by ','.
+	Returns 0 if the source was added.
+------------------------------------------------------------------------------------- */
+static int addSource(MidiInput *m, char *text)
+{
+	MidiSource *src = &m->source[m->numSources];
+	char *opt, *save;
+
+	if (m->numSources == MIDI_SOURCES) {
+		printf("At most %d midi sources, %s left out\n", MIDI_SOURCES, text);
+		return 1;
+	}
+	opt = strtok_r(text, ",", &save);
+	if (opt == NULL)
+		return 1;
+	memset(src, 0, sizeof(MidiSource));
+	src->channel = src->only = -1;
+	if (strncmp(opt, "file:", 5) == 0) {
+		src->type = SOURCE_FILE;
+		opt += 5;
+	}
+	snprintf(src->name, sizeof(src->name), "%s", opt);
+
+	while ((opt = strtok_r(NULL, ",", &save)) != NULL) {
+		if (strncmp(opt, "ch=", 3) == 0 && channelOption(opt + 3) >= 0)
+			src->channel = channelOption(opt + 3);
+		else if (strncmp(opt, "in=", 3) == 0 && channelOption(opt + 3) >= 0)
+			src->only = channelOption(opt + 3);
+		else if (strcmp(opt, "loop") == 0)
+			src->loop = 1;
+		else if (strcmp(opt, "-notes") == 0)
+			src->drop |= DROP_NOTES;
+		else if (strcmp(opt, "-control") == 0)
+			src->drop |= DROP_CONTROL;
+		else if (strcmp(opt, "-program") == 0)
+			src->drop |= DROP_PROGRAM;
+		else if (strcmp(opt, "-pressure") == 0)
+			src->drop |= DROP_PRESSURE;
+		else if (strcmp(opt, "-bend") == 0)
+			src->drop |= DROP_BEND;
+		else
+			printf("Unknown midi option %s for %s\n", opt, src->name);
+	}
+
+	if (src->type == SOURCE_FILE) {
+		src->file = readMidiFile(src->name);
+		if (src->file == NULL) {
+			printf("Cannot read midi file %s\n", src->name);
+			return 1;
+		}
+		src->start = Pt_Time();
+		printf("Midi file %s: %d events, %.1f s%s\n", src->name, src->file->count,
+		       src->file->length, src->loop ? ", looped" : "");
+	}
+	m->numSources++;
+	return 0;
+}
+
+MidiInput *openMidiInput(const char *spec, RingBuffer *queue, Stats *stats)
+{
+	MidiInput *m = (MidiInput *)calloc(1, sizeof(MidiInput));
+	char *text, *item, *save;
+	int i;
+
+	if (m == NULL)
+		return NULL;
+	m->queue = queue;
+	m->stats = stats;
+	text = strdup(spec);
+	for (item = strtok_r(text, ";", &save); item != NULL; item = strtok_r(NULL, ";", &save))
+		addSource(m, item);
+	free(text);
+	if (m->numSources == 0) {
+		free(m);
+		return NULL;
+	}
+
+	attachPorts(m, 0);
+	for (i = 0; i < m->numSources; i++) {
+		if (m->source[i].type == SOURCE_PORT && !m->source[i].open)
+			printf("No midi input matches %s, waiting for it.\n", m->source[i].name);
+	}
+	atomic_store(&m->running, 1);
+	if (pthread_create(&m->thread, NULL, pollMidi, m) != 0) {
+		atomic_store(&m->running, 0);
+		closeMidiInput(m);
+		return NULL;
+	}
+	return m;
+}
+
+void closeMidiInput(MidiInput *m)
+{
+	int i;
+
+	if (m == NULL)
+		return;
+	/* the thread sleeps at most MIDI_DETACHED_NS at a time, so it stops at once */
+	if (atomic_load(&m->running)) {
+		atomic_store_explicit(&m->running, 0, memory_order_release);
+		pthread_join(m->thread, NULL);
+	}
+	for (i = 0; i < m->numSources; i++) {
+		if (m->source[i].open)
+			Pm_Close(m->source[i].port);
+		freeMidiFile(m->source[i].file);
+	}
+	free(m);
+}
@@ -0,0 +1,106 @@
+
+/*-----------------------------------------------------------------------------------
+    MIDIIN
+
+    Midi input: any number of sources read by one thread, and merged into the event
+	queue of the audio thread.
+
+	-a source is a PortMidi input chosen by name, or a midi file that is played
+	 into the synth as if it came from a sequencer
+	-each source can move its events to another channel, take only one channel,
+	 and drop kinds of messages
+	-the thread reads what every source has into a batch of its own, merges the
+	 batches in timestamp order and writes the result into the queue at once. The
+	 audio thread takes all inputs with one read, so its work per event is the
+	 same however many sources there are
+	-a port that reports an error is taken to be unplugged. The notes on its
+	 channels are turned off and the port is looked for again every
+	 MIDI_RESCAN_MS, while the other sources keep playing. PortMidi reads its list
+	 of devices only when it starts, and starting it again would close the open
+	 ports, so the list is read again only while no port is open
+
+	The sources are given as a list separated by ';'. Each is a name (or a shell
+	wildcard pattern) of a midi input, or file:name.mid, followed by options
+	separated by ',':
+	    ch=N        all events to channel N (1-16)
+	    in=N        only the events of channel N
+	    loop        a file is played over and over
+	    -notes -control -program -pressure -bend
+	                drops those messages, key pressure goes with -notes and
+	                with -pressure
+	e.g.  "Keystation*,ch=1;nanoKONTROL*,-notes,ch=2;file:drums.mid,ch=10,loop"
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef MIDIIN_H
+#define MIDIIN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <portmidi.h>
+#include <porttime.h>
+#include "ringbuf.h"
+#include "stats.h"
+#include "midifile.h"
+
+/* sources at most, and events read from one source at once */
+#define MIDI_SOURCES 16
+#define MIDI_BATCH 64
+
+/* how long the thread sleeps when no source has data, and when there is no source to read (nanoseconds) */
+#define MIDI_IDLE_NS 250000
+#define MIDI_DETACHED_NS 10000000
+
+/* how often the midi devices are scanned while a port is missing (milliseconds) */
+#define MIDI_RESCAN_MS 1000
+
+/* longest name pattern of a midi input */
+#define MIDI_PATTERN 256
+
+#define SOURCE_PORT 0
+#define SOURCE_FILE 1
+
+typedef struct
+{
+	int   type;
+	char  name[MIDI_PATTERN];   /* name pattern of the port, or the file name */
+	int   channel;              /* channel the events are moved to, -1 to keep them */
+	int   only;                 /* the only channel taken, -1 for all */
+	int   drop;                 /* message kinds dropped, bit (status >> 4) - 8 */
+	int   loop;
+
+	PmStream *port;
+	int   open;
+	MidiFile *file;
+	int   next;                 /* next event of the file */
+	double start;               /* porttime of the start of the file, ms */
+
+	PmEvent batch[MIDI_BATCH];  /* events read in this round */
+	int   count, pos;
+} MidiSource;
+
+typedef struct
+{
+	MidiSource source[MIDI_SOURCES];
+	int   numSources;
+	RingBuffer *queue;
+	Stats *stats;
+	PmEvent merged[MIDI_SOURCES * MIDI_BATCH];
+	atomic_int running;
+	pthread_t thread;
+} MidiInput;
+
+
+/*---------------------------------------------------------------------------
+	openMidiInput opens the sources of spec and starts the thread that writes
+	their events into queue. PortMidi and porttime must be started. A port that
+	is not there yet is waited for. Returns NULL if spec has no usable source.
+------------------------------------------------------------------------------*/
+MidiInput *openMidiInput(const char *spec, RingBuffer *queue, Stats *stats);
+
+/*---------------------------------------------------------------------------
+	closeMidiInput stops the thread and closes the sources
+------------------------------------------------------------------------------*/
+void closeMidiInput(MidiInput *m);
+
+#endif
@@ -0,0 +1,235 @@
+
+#include <stdlib.h>
+#include <math.h>
+#include "modulation.h"
+
+/* size of the lfo sine table */
+#define LFO_TABLE 256
+
+static float sineTable[LFO_TABLE + 1];
+
+
+/* -------------------------------------------------------------------------------------
+	createModMatrix
+------------------------------------------------------------------------------------- */
+ModMatrix *createModMatrix(float samplerate)
+{
+	ModMatrix *m = malloc(sizeof(ModMatrix));
+	int i;
+
+	for (i = 0; i <= LFO_TABLE; i++)
+		sineTable[i] = sin(2 * M_PI * i / LFO_TABLE);
+
+	for (i = 0; i < NUM_LFOS; i++) {
+		m->lfo[i].shape = LFO_SINE;
+		m->lfo[i].rate = 5;
+		m->lfo[i].phase = 0;
+		m->lfo[i].value = 0;
+		m->lfo[i].seed = 22222 + i;
+	}
+	for (i = 0; i < MOD_SLOTS; i++)
+		modSetSlot(m, i, SRC_NONE, SRC_NONE, DST_NONE, 0);
+	for (i = 0; i < NUM_SRCS; i++)
+		m->ctrl[i] = m->cur[i] = m->next[i] = 0;
+
+	m->samplerate = samplerate;
+	m->ctrlRate = CTRL_RATE;
+	m->coarse = 0;
+	m->tickLeft = 0;
+	m->numSegs = 0;
+
+	/* the default routing */
+	modSetSlot(m, 0, SRC_LFO1, SRC_NONE, DST_PITCH, 0.05);
+	modSetSlot(m, 1, SRC_LFO1, SRC_PRESSURE, DST_PITCH, 0.5);
+	return m;
+}
+
+void destroyModMatrix(ModMatrix *m)
+{
+	free(m);
+}
+
+/* -------------------------------------------------------------------------------------
+	modSetSlot, modSetRate, modSetSource, modSetCoarse
+------------------------------------------------------------------------------------- */
+void modSetSlot(ModMatrix *m, int slot, int src, int via, int dst, float amount)
+{
+	if (slot < 0 || slot >= MOD_SLOTS)
+		return;
+	m->slot[slot].src = src;
+	m->slot[slot].via = via;
+	m->slot[slot].dst = dst;
+	m->slot[slot].amount = amount;
+	m->dirty = 1;
+}
+
+void modSetRate(ModMatrix *m, int ctrlRate)
+{
+	if (ctrlRate < CTRL_RATE_MIN) ctrlRate = CTRL_RATE_MIN;
+	if (ctrlRate > DSP_BLOCK) ctrlRate = DSP_BLOCK;
+	m->ctrlRate = ctrlRate;
+	if (m->tickLeft > ctrlRate)
+		m->tickLeft = ctrlRate;
+}
+
+void modSetSource(ModMatrix *m, int src, float value)
+{
+	if (src > SRC_NONE && src < SRC_VOICE)
+		m->ctrl[src] = value;
+}
+
+void modSetCoarse(ModMatrix *m, int coarse)
+{
+	m->coarse = coarse;
+	if (!coarse && m->tickLeft > m->ctrlRate)
+		m->tickLeft = m->ctrlRate;
+}
+
+/* -------------------------------------------------------------------------------------
+	compile: the slots that do something are copied into the operation lists
+------------------------------------------------------------------------------------- */
+static void compile(ModMatrix *m)
+{
+	ModSlot *s;
+	ModOp *op;
+	int i;
+
+	m->numGlobal = m->numVoice = 0;
+	for (i = 0; i < MOD_SLOTS; i++) {
+		s = &m->slot[i];
+		if (s->src <= SRC_NONE || s->src >= NUM_SRCS || s->dst <= DST_NONE || s->dst >= NUM_DSTS
+		    || s->via < SRC_NONE || s->via >= NUM_SRCS || s->amount == 0)
+			continue;
+		if (s->src >= SRC_VOICE || s->via >= SRC_VOICE)
+			op = &m->voiceOp[m->numVoice++];
+		else
+			op = &m->globalOp[m->numGlobal++];
+		op->src = s->src;
+		op->via = s->via;
+		op->dst = s->dst;
+		op->amount = s->amount;
+	}
+	m->dirty = 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	lfoTick: the lfo is advanced by one control period
+------------------------------------------------------------------------------------- */
+static float lfoTick(Lfo *l, float periods)
+{
+	float x;
+	int i;
+
+	l->phase += l->rate * periods;
+	if (l->phase >= 1) {
+		l->phase -= (int)l->phase;
+		l->seed = l->seed * 1664525 + 1013904223;
+		if (l->shape == LFO_RANDOM)
+			l->value = (l->seed >> 8) * (2.0f / 16777216) - 1;
+	}
+
+	switch (l->shape) {
+		case LFO_SINE:
+			x = l->phase * LFO_TABLE;
+			i = (int)x;
+			l->value = sineTable[i] + (x - i) * (sineTable[i + 1] - sineTable[i]);
+			break;
+		case LFO_TRIANGLE:
+			l->value = 1 - 4 * fabsf(l->phase - 0.5f);
+			break;
+		case LFO_SAW:
+			l->value = 2 * l->phase - 1;
+			break;
+		case LFO_SQUARE:
+			l->value = (l->phase < 0.5f) ? 1 : -1;
+			break;
+	}
+	return l->value;
+}
+
+/* -------------------------------------------------------------------------------------
+	tick: the source values at the next control point
+------------------------------------------------------------------------------------- */
+static void tick(ModMatrix *m)
+{
+	int rate = m->coarse ? DSP_BLOCK : m->ctrlRate;
+	float periods = rate / m->samplerate;
+	int i;
+
+	for (i = 0; i < NUM_LFOS; i++)
+		m->next[SRC_LFO1 + i] = lfoTick(&m->lfo[i], periods);
+	for (i = SRC_LFO1 + NUM_LFOS; i < SRC_VOICE; i++)
+		m->next[i] = m->ctrl[i];
+	m->tickLeft = rate;
+}
+
+/* -------------------------------------------------------------------------------------
+	runOps: the destinations are computed from zero
+------------------------------------------------------------------------------------- */
+static void runOps(const ModOp *op, int n, const float *src, float *dst)
+{
+	int i, d;
+
+	for (d = 0; d < NUM_DSTS; d++)
+		dst[d] = 0;
+	for (i = 0; i < n; i++)
+		dst[op[i].dst] += op[i].amount * src[op[i].src] * (op[i].via ? src[op[i].via] : 1);
+}
+
+/* -------------------------------------------------------------------------------------
+	modBlock
+------------------------------------------------------------------------------------- */
+int modBlock(ModMatrix *m, int n)
+{
+	ModSegment *s;
+	float f;
+	int pos = 0, i;
+
+	if (m->dirty)
+		compile(m);
+
+	m->numSegs = 0;
+	while (pos < n) {
+		if (m->tickLeft == 0)
+			tick(m);
+		s = &m->seg[m->numSegs++];
+		s->pos = pos;
+		s->len = (m->tickLeft < n - pos) ? m->tickLeft : n - pos;
+
+		/* the sources move linearly towards the next control point */
+		f = (float)s->len / m->tickLeft;
+		for (i = 0; i < SRC_VOICE; i++) {
+			s->src[0][i] = m->cur[i];
+			m->cur[i] += (m->next[i] - m->cur[i]) * f;
+			s->src[1][i] = m->cur[i];
+		}
+		runOps(m->globalOp, m->numGlobal, s->src[0], s->dst[0]);
+		runOps(m->globalOp, m->numGlobal, s->src[1], s->dst[1]);
+
+		m->tickLeft -= s->len;
+		pos += s->len;
+	}
+	return m->numSegs;
+}
+
+/* -------------------------------------------------------------------------------------
+	modVoice: the global part is already in the segment, only the operations with a
+	voice source are run
+------------------------------------------------------------------------------------- */
+void modVoice(const ModMatrix *m, const ModSegment *s, int end, const float *vsrc, float *dst)
+{
+	const ModOp *op = m->voiceOp;
+	float a, b;
+	int i;
+
+	for (i = 0; i < NUM_DSTS; i++)
+		dst[i] = s->dst[end][i];
+	for (i = 0; i < m->numVoice; i++) {
+		a = (op[i].src >= SRC_VOICE) ? vsrc[op[i].src - SRC_VOICE] : s->src[end][op[i].src];
+		if (op[i].via == SRC_NONE)
+			b = 1;
+		else
+			b = (op[i].via >= SRC_VOICE) ? vsrc[op[i].via - SRC_VOICE] : s->src[end][op[i].via];
+		dst[op[i].dst] += op[i].amount * a * b;
+	}
+}
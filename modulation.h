@@ -0,0 +1,153 @@
+
+/*-----------------------------------------------------------------------------------
+    MODULATION
+
+    LFOs and the modulation matrix. The LFOs and the controller sources are
+	evaluated at control rate, every ctrlRate samples, and interpolated linearly
+	between the control points, so a block is rendered in a few segments with
+	smoothly changing modulation.
+
+	-a slot of the matrix adds amount * source * via to a destination, a via of
+	 SRC_NONE counts as 1
+	-the slots are compiled into two flat lists of operations: the ones that use
+	 only global sources are run once per segment, the ones that use a voice
+	 source (velocity, key) once per segment for each voice
+	-the destinations are computed from zero at every control point, modulation
+	 never accumulates into the voice state
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef MODULATION_H
+#define MODULATION_H
+
+#include "dsp.h"
+
+#define NUM_LFOS  3
+#define MOD_SLOTS 16
+
+/* control rate in samples, and the limits for it */
+#define CTRL_RATE     32
+#define CTRL_RATE_MIN 8
+#define MOD_SEGMENTS  (DSP_BLOCK / CTRL_RATE_MIN + 2)
+
+/* lfo shapes */
+#define LFO_SINE     0
+#define LFO_TRIANGLE 1
+#define LFO_SAW      2
+#define LFO_SQUARE   3
+#define LFO_RANDOM   4   /* sample and hold, a new value every cycle */
+
+/* modulation sources. LFOs are -1..1, controllers and velocity 0..1, key is
+   (note - 60) / 64. The voice sources are last. */
+#define SRC_NONE     0
+#define SRC_LFO1     1
+#define SRC_LFO2     2
+#define SRC_LFO3     3
+#define SRC_MODWHEEL 4
+#define SRC_BREATH   5
+#define SRC_FOOT     6
+#define SRC_PRESSURE 7
+#define SRC_VELOCITY 8
+#define SRC_KEY      9
+#define NUM_SRCS     10
+#define SRC_VOICE    SRC_VELOCITY  /* first voice source */
+
+/* modulation destinations */
+#define DST_NONE  0
+#define DST_PITCH 1   /* semitones */
+#define DST_AMP   2   /* the voice level is multiplied by 1 + value */
+#define DST_PW    3   /* pulse width, percent */
+#define DST_CUTOFF 4  /* filter cutoff, semitones */
+#define NUM_DSTS  5
+
+
+typedef struct
+{
+	int   shape;
+	float rate;            /* Hz */
+	float phase;           /* cycles */
+	float value;
+	unsigned int seed;     /* for the random shape */
+} Lfo;
+
+/* one slot of the matrix, as set by the user */
+typedef struct
+{
+	int   src, via, dst;
+	float amount;
+} ModSlot;
+
+/* a compiled operation */
+typedef struct
+{
+	unsigned char src, via, dst;
+	float amount;
+} ModOp;
+
+/* a piece of a block between control points: the global sources and the
+   destinations computed from them, at the start [0] and at the end [1] */
+typedef struct
+{
+	int   pos, len;
+	float src[2][NUM_SRCS];
+	float dst[2][NUM_DSTS];
+} ModSegment;
+
+typedef struct
+{
+	Lfo     lfo[NUM_LFOS];
+	ModSlot slot[MOD_SLOTS];
+	float   ctrl[NUM_SRCS];     /* latest controller values */
+	int     ctrlRate;
+	int     coarse;             /* the control rate is lowered to one point per block */
+	float   samplerate;
+
+	/* compiled from the slots */
+	ModOp   globalOp[MOD_SLOTS];
+	int     numGlobal;
+	ModOp   voiceOp[MOD_SLOTS];
+	int     numVoice;
+	int     dirty;
+
+	/* control rate state */
+	float   cur[NUM_SRCS];      /* source values now */
+	float   next[NUM_SRCS];     /* source values at the next control point */
+	int     tickLeft;           /* samples to the next control point */
+
+	ModSegment seg[MOD_SEGMENTS];
+	int     numSegs;
+} ModMatrix;
+
+
+/*---------------------------------------------------------------------------
+	createModMatrix returns a matrix with the default routing: LFO 1 gives a
+	slight vibrato, which channel pressure deepens
+------------------------------------------------------------------------------*/
+ModMatrix *createModMatrix(float samplerate);
+
+void destroyModMatrix(ModMatrix *m);
+
+/*---------------------------------------------------------------------------
+	modSetSlot sets one slot of the matrix, modSetRate sets the control rate
+	in samples. modSetSource sets the value of a controller source.
+	modSetCoarse switches to one control point per DSP_BLOCK samples and back,
+	without changing the control rate that was set.
+------------------------------------------------------------------------------*/
+void modSetSlot(ModMatrix *m, int slot, int src, int via, int dst, float amount);
+void modSetRate(ModMatrix *m, int ctrlRate);
+void modSetSource(ModMatrix *m, int src, float value);
+void modSetCoarse(ModMatrix *m, int coarse);
+
+/*---------------------------------------------------------------------------
+	modBlock advances the LFOs over the next n <= DSP_BLOCK samples and divides
+	them into segments at the control points. Returns the number of segments.
+------------------------------------------------------------------------------*/
+int modBlock(ModMatrix *m, int n);
+
+/*---------------------------------------------------------------------------
+	modVoice computes the destinations of a voice at the start (end = 0) or at
+	the end (end = 1) of a segment. vsrc holds the values of the voice sources.
+------------------------------------------------------------------------------*/
+void modVoice(const ModMatrix *m, const ModSegment *s, int end, const float *vsrc, float *dst);
+
+#endif
@@ -1,89 +1,151 @@
 
 #include "notelist.h"
 
+#define HEAD NOTE_SLOTS
+
 
 /* -------------------------------------------------------------------------------------
-	createNotelist 
+	createNotelist
 ------------------------------------------------------------------------------------- */
-MIDInote *createNotelist()
+Notelist *createNotelist()
 {
-	MIDInote *list = malloc(sizeof(MIDInote));
-	list->next = NULL;
-	list->note = -1;
-	list->vel = -1;
-	list->chan = -1;
+	Notelist *list = malloc(sizeof(Notelist));
+	int i;
+
+	for (i = 0; i < NOTE_SLOTS; i++)
+		list->slot[i].vel = 0;
+	list->slot[HEAD].prev = list->slot[HEAD].next = HEAD;
+	for (i = 0; i < NOTE_NUMBERS; i++)
+		list->count[i] = 0;
+	list->held[0] = list->held[1] = 0;
+	list->size = 0;
 	return list;
 }
 
 
 /* -----------------------------------------------------------------------------------
-	resetNotelist : deletes all notes from the list, except the first, dummy note.
+	resetNotelist : only the notes that are on are visited
 ------------------------------------------------------------------------------------- */
-int resetNotelist(MIDInote *list)
+int resetNotelist(Notelist *list)
 {
-	MIDInote *tmp = list->next, *tmp2;
-	
-	while (tmp != NULL) {
-			tmp2 = tmp->next;				    /*  printf("freed %d\n", tmp->note); */
-			free(tmp);	
-			tmp = tmp2;
+	int s, removed = list->size;
+
+	for (s = list->slot[HEAD].next; s != HEAD; s = list->slot[s].next) {
+		list->slot[s].vel = 0;
+		list->count[s % NOTE_NUMBERS] = 0;
 	}
+	list->slot[HEAD].prev = list->slot[HEAD].next = HEAD;
+	list->held[0] = list->held[1] = 0;
+	list->size = 0;
+	return removed;
+}
+
+/* -----------------------------------------------------------------------------------
+	unlinkSlot / linkLast: take a slot out of the order list, put a slot at its end
+------------------------------------------------------------------------------------- */
+static void unlinkSlot(Notelist *list, int s)
+{
+	list->slot[list->slot[s].prev].next = list->slot[s].next;
+	list->slot[list->slot[s].next].prev = list->slot[s].prev;
+}
+
+static void linkLast(Notelist *list, int s)
+{
+	list->slot[s].prev = list->slot[HEAD].prev;
+	list->slot[s].next = HEAD;
+	list->slot[list->slot[HEAD].prev].next = s;
+	list->slot[HEAD].prev = s;
 }
 
 /* -----------------------------------------------------------------------------------
-	addNote: 
+	addNote:
 ------------------------------------------------------------------------------------- */
-void addNote(MIDInote *list, unsigned char chan, unsigned char note, unsigned char vel)
+void addNote(Notelist *list, unsigned char chan, unsigned char note, unsigned char vel)
 {
-	MIDInote *tmp;
-	tmp = list;
-	while (tmp->next != NULL) {
-		tmp = tmp->next; 
+	int s = (chan % NOTE_CHANNELS) * NOTE_NUMBERS + (note % NOTE_NUMBERS);
+
+	if (vel == 0)
+		vel = 1;   /* velocity 0 marks a free slot */
+
+	if (list->slot[s].vel > 0) {
+		/* the note is already on: it becomes the last note */
+		unlinkSlot(list, s);
+	}
+	else {
+		note %= NOTE_NUMBERS;
+		if (list->count[note]++ == 0)
+			list->held[note >> 6] |= 1ULL << (note & 63);
+		list->size++;
 	}
-	tmp->next = malloc(sizeof(MIDInote));                                  	  /*printf("created new note\n"); */
-	tmp = tmp->next;
-	tmp->note = note;
-	tmp->vel = vel;
-	tmp->next = NULL;
+	list->slot[s].vel = vel;
+	linkLast(list, s);
 }
 
 /* ---------------------------------------------------------------------------------------
 	removeNote:
 -------------------------------------------------------------------------------------------- */
-void removeNote(MIDInote *list, unsigned char chan, unsigned char note)
+void removeNote(Notelist *list, unsigned char chan, unsigned char note)
 {
-	MIDInote *tmp, *tmp2;
-	tmp = list;
-	while (tmp->next != NULL) {
-		if (tmp->next->note == note) {
-			/* remove note from the middle of the list */
-			if (tmp->next->next != NULL) {
-				tmp2 = tmp->next->next;
-				free(tmp->next);												/* printf("freed note from middle\n");  */
-				tmp->next = tmp2;
-			}
-			/* remove note from the end */
-			else {
-				free(tmp->next);												/* printf("freed last note\n"); */
-				tmp->next = NULL;
-				break; /* when last note is removed, get out of the while loop */
-			}
-		}	
-		tmp = tmp->next;
-	}
+	int s = (chan % NOTE_CHANNELS) * NOTE_NUMBERS + (note % NOTE_NUMBERS);
+
+	if (list->slot[s].vel == 0)
+		return;
+	unlinkSlot(list, s);
+	list->slot[s].vel = 0;
+	note %= NOTE_NUMBERS;
+	if (--list->count[note] == 0)
+		list->held[note >> 6] &= ~(1ULL << (note & 63));
+	list->size--;
 }
 
 /* -------------------------------------------------------------------------------------------
-	lastNote 
+	lastNote, lastNoteChan
 --------------------------------------------------------------------------------------------- */
-short lastNote(MIDInote *list)
+short lastNote(Notelist *list)
 {
-	if (list == NULL)
+	if (list == NULL || list->size == 0)
 		return -1;
-	MIDInote *tmp = list;
-	while (tmp->next != NULL) {
-		tmp = tmp->next;		
-	} 
-	return tmp->note;
+	return list->slot[HEAD].prev % NOTE_NUMBERS;
 }
 
+short lastNoteChan(Notelist *list)
+{
+	if (list == NULL || list->size == 0)
+		return -1;
+	return list->slot[HEAD].prev / NOTE_NUMBERS;
+}
+
+/* -------------------------------------------------------------------------------------------
+	highestNote, lowestNote: the bit masks of held note numbers are searched with
+	count leading / trailing zeros, two words at most
+--------------------------------------------------------------------------------------------- */
+short highestNote(Notelist *list)
+{
+	if (list->held[1])
+		return 127 - __builtin_clzll(list->held[1]);
+	if (list->held[0])
+		return 63 - __builtin_clzll(list->held[0]);
+	return -1;
+}
+
+short lowestNote(Notelist *list)
+{
+	if (list->held[0])
+		return __builtin_ctzll(list->held[0]);
+	if (list->held[1])
+		return 64 + __builtin_ctzll(list->held[1]);
+	return -1;
+}
+
+/* -------------------------------------------------------------------------------------------
+	noteVelocity, noteCount
+--------------------------------------------------------------------------------------------- */
+short noteVelocity(Notelist *list, unsigned char chan, unsigned char note)
+{
+	return list->slot[(chan % NOTE_CHANNELS) * NOTE_NUMBERS + (note % NOTE_NUMBERS)].vel;
+}
+
+int noteCount(Notelist *list)
+{
+	return list->size;
+}
@@ -1,53 +1,87 @@
 
-/*-----------------------------------------------------------------------------------  
+/*-----------------------------------------------------------------------------------
     NOTELIST
     Copyright (c) 2008 Tommi Salomaa
 
     Data structure for storing midi note events. Does not store time information.
 
-	-storing note-on message for a note which is already on does not work well
+	-every note of every channel has a fixed slot, so nothing is allocated when
+	 notes are added or removed, and all operations take constant time
+	-the notes that are on are linked in the order they were received
+	-a note-on for a note which is already on moves it to be the last note and
+	 updates its velocity, a single note-off removes it
 
 	last modification: 3.5.2008
 
 ----------------------------------------------------------------------------------------*/
 
+#ifndef NOTELIST_H
+#define NOTELIST_H
+
 #include <stdio.h>
 #include <stdlib.h>
 
-/* Note events are stored into a linked list with note number and channel data. */
-typedef struct MIDInote {
-	short note;
-	short vel;
-	short chan;
-	struct MIDInote *next;
-} MIDInote;
+#define NOTE_CHANNELS 16
+#define NOTE_NUMBERS  128
+#define NOTE_SLOTS    (NOTE_CHANNELS * NOTE_NUMBERS)
+
+/* slot of a note, indexed by channel * NOTE_NUMBERS + note */
+typedef struct {
+	short vel;      /* velocity, 0 when the note is off */
+	short prev;     /* previous and next slot in the order of arrival */
+	short next;
+} NoteSlot;
+
+typedef struct Notelist {
+	NoteSlot slot[NOTE_SLOTS + 1];       /* the extra slot is the head of the order list */
+	unsigned char count[NOTE_NUMBERS];   /* on how many channels each note number is on */
+	unsigned long long held[2];          /* one bit for each note number that is on */
+	int size;                            /* number of notes on */
+} Notelist;
 
 
 /*---------------------------------------------------------------------------
-	createNotelist returns a pointer to first 'dummy' node of a notelist
+	createNotelist returns a pointer to an empty notelist
 ------------------------------------------------------------------------------*/
-MIDInote *createNotelist();
+Notelist *createNotelist();
 
 /*--------------------------------------------------------------------------
- 	resetNotelist deletes all notes in the notelist 
+ 	resetNotelist deletes all notes in the notelist, returns how many there were
 ----------------------------------------------------------------------------*/
-int resetNotelist(MIDInote *list);
+int resetNotelist(Notelist *list);
 
 
 /* -----------------------------------------------------------------------------
-	addNote adds a note to the list, by midi channel and velocity 
+	addNote adds a note to the list, by midi channel and velocity
 ------------------------------------------------------------------------------*/
-void addNote(MIDInote *list, unsigned char chan, unsigned char note, unsigned char vel); 
+void addNote(Notelist *list, unsigned char chan, unsigned char note, unsigned char vel);
 
 /* ----------------------------------------------------------------------------
 	removes given note on given channel from the list
 -------------------------------------------------------------------------------*/
-void removeNote(MIDInote *list, unsigned char chan, unsigned char note); 
+void removeNote(Notelist *list, unsigned char chan, unsigned char note);
 
 /*----------------------------------------------------------------------------
-	lastNote returns the last note in the notelist. In monophonic context the 
+	lastNote returns the last note in the notelist. In monophonic context the
 	last received note is usually the note that plays.
-	If there are no notes lastNote returns value of -1.             
+	If there are no notes lastNote returns value of -1.
+	lastNoteChan returns the channel of the last note, or -1.
+-----------------------------------------------------------------------------*/
+short lastNote(Notelist *list);
+short lastNoteChan(Notelist *list);
+
+/*----------------------------------------------------------------------------
+	highestNote and lowestNote return the highest and lowest note number that
+	is on in any channel, or -1 if there are no notes.
+-----------------------------------------------------------------------------*/
+short highestNote(Notelist *list);
+short lowestNote(Notelist *list);
+
+/*----------------------------------------------------------------------------
+	noteVelocity returns the velocity of a note, 0 if the note is not on
+	noteCount returns the number of notes on
 -----------------------------------------------------------------------------*/
-short lastNote(MIDInote *list);
+short noteVelocity(Notelist *list, unsigned char chan, unsigned char note);
+int noteCount(Notelist *list);
 
+#endif
@@ -0,0 +1,79 @@
+
+#include <stdlib.h>
+#include "params.h"
+
+
+/* -------------------------------------------------------------------------------------
+	createParamStore
+------------------------------------------------------------------------------------- */
+ParamStore *createParamStore()
+{
+	ParamStore *ps = malloc(sizeof(ParamStore));
+	int p, i;
+
+	for (p = 0; p < NUM_PARTS; p++) {
+		for (i = 0; i < NUM_PARAMS; i++)
+			ps->value[p][i] = 0;
+	}
+	ps->queue = createRingBuffer(PARAM_QUEUE_SIZE, sizeof(ParamChange));
+	return ps;
+}
+
+void destroyParamStore(ParamStore *ps)
+{
+	if (ps == NULL)
+		return;
+	destroyRingBuffer(ps->queue);
+	free(ps);
+}
+
+/* -------------------------------------------------------------------------------------
+	paramInit
+------------------------------------------------------------------------------------- */
+void paramInit(ParamStore *ps, int part, int id, float value)
+{
+	if (part >= 0 && part < NUM_PARTS && id >= 0 && id < NUM_PARAMS)
+		ps->value[part][id] = value;
+}
+
+/* -------------------------------------------------------------------------------------
+	paramSet: a change for all parts is sent as one message for each part, so the
+	audio thread handles only single changes
+------------------------------------------------------------------------------------- */
+int paramSet(ParamStore *ps, int part, int id, float value)
+{
+	ParamChange c;
+	int first = part, last = part, lost = 0;
+
+	if (id < 0 || id >= NUM_PARAMS)
+		return 0;
+	if (part == ALL_PARTS) {
+		first = 0;
+		last = NUM_PARTS - 1;
+	}
+	else if (part < 0 || part >= NUM_PARTS)
+		return 0;
+
+	c.id = id;
+	c.value = value;
+	for (c.part = first; c.part <= last; c.part++) {
+		ps->value[c.part][id] = value;
+		lost += 1 - ringWrite(ps->queue, &c, 1);
+	}
+	return lost;
+}
+
+float paramGet(ParamStore *ps, int part, int id)
+{
+	if (part < 0 || part >= NUM_PARTS || id < 0 || id >= NUM_PARAMS)
+		return 0;
+	return ps->value[part][id];
+}
+
+/* -------------------------------------------------------------------------------------
+	paramTake
+------------------------------------------------------------------------------------- */
+int paramTake(ParamStore *ps, ParamChange *out, int max)
+{
+	return ringRead(ps->queue, out, max);
+}
@@ -0,0 +1,128 @@
+
+/*-----------------------------------------------------------------------------------
+    PARAMS
+
+    Parameter store for the sound parameters of the parts. The console (or any
+	other thread that is not the audio thread) sets parameters here, and each
+	change is published to the audio thread as a small message through a
+	wait-free queue. The audio thread applies the changes between blocks, so
+	a block is always rendered from one consistent set of parameters.
+
+	-the store keeps the latest value set for every parameter, for the writing
+	 thread to read back. Controller changes from midi are applied on the audio
+	 thread directly and are not seen here
+	-only one thread may set parameters, and only the audio thread takes them
+	-parameters that would click if they jumped (gain, pan, pulse width) are
+	 smoothed: they move towards their target once per block, and the voices
+	 ramp between the values at the start and the end of the block
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <math.h>
+#include "ringbuf.h"
+#include "envelope.h"
+
+/* one part for each midi channel */
+#define NUM_PARTS 16
+
+/* each envelope has the values of stages ATT - REL and the shape */
+#define ENV_PARAMS 5
+#define ENV_SHAPE  4
+
+/* parameters of a part */
+#define PARAM_WAVEFORM 0
+#define PARAM_GAIN     1   /* 0-1 */
+#define PARAM_PAN      2   /* 0-127, 64 is the middle */
+#define PARAM_PW       3   /* pulse width, percent */
+#define PARAM_ENV      4   /* the envelope parameters start here */
+#define NUM_PARAMS     (PARAM_ENV + NUM_ENVS * ENV_PARAMS)
+
+#define ENV_PARAM(env, i) (PARAM_ENV + (env) * ENV_PARAMS + (i))
+
+/* part number that sets a parameter of all parts */
+#define ALL_PARTS -1
+
+/* changes that can wait in the queue, enough for every part to change a few times */
+#define PARAM_QUEUE_SIZE 256
+
+/* time constant of the smoothed parameters (seconds) */
+#define SMOOTH_TIME 0.02
+
+/* a change on its way to the audio thread */
+typedef struct
+{
+	short part, id;
+	float value;
+} ParamChange;
+
+typedef struct
+{
+	float value[NUM_PARTS][NUM_PARAMS]; /* latest values set, owned by the writing thread */
+	RingBuffer *queue;                   /* changes not yet taken by the audio thread */
+} ParamStore;
+
+/* a smoothed parameter: from is the value at the start of the current block and
+   cur the value at its end */
+typedef struct
+{
+	float from, cur, target;
+} Smooth;
+
+
+/*---------------------------------------------------------------------------
+	createParamStore returns a store with all values 0, destroyParamStore
+------------------------------------------------------------------------------*/
+ParamStore *createParamStore();
+void destroyParamStore(ParamStore *ps);
+
+/*---------------------------------------------------------------------------
+	paramInit sets the stored value without publishing it, for the initial
+	state of the parts before the audio starts
+------------------------------------------------------------------------------*/
+void paramInit(ParamStore *ps, int part, int id, float value);
+
+/*---------------------------------------------------------------------------
+	paramSet stores the value of a parameter of part (or ALL_PARTS) and
+	publishes the change. Returns the number of changes that did not fit into
+	the queue, 0 normally.
+	paramGet returns the latest value set.
+------------------------------------------------------------------------------*/
+int paramSet(ParamStore *ps, int part, int id, float value);
+float paramGet(ParamStore *ps, int part, int id);
+
+/*---------------------------------------------------------------------------
+	paramTake takes up to max changes from the queue, in the order they were
+	set. Called by the audio thread only.
+------------------------------------------------------------------------------*/
+int paramTake(ParamStore *ps, ParamChange *out, int max);
+
+/*---------------------------------------------------------------------------
+	smoothReset jumps to value, smoothSet sets the target.
+	smoothBlock moves the value towards the target by coef (0-1), once per
+	block. Returns 1 if the value changed during the block.
+------------------------------------------------------------------------------*/
+static inline void smoothReset(Smooth *s, float value)
+{
+	s->from = s->cur = s->target = value;
+}
+
+static inline void smoothSet(Smooth *s, float target)
+{
+	s->target = target;
+}
+
+static inline int smoothBlock(Smooth *s, float coef)
+{
+	s->from = s->cur;
+	if (s->cur != s->target) {
+		s->cur += (s->target - s->cur) * coef;
+		if (fabsf(s->target - s->cur) < 1e-5f)
+			s->cur = s->target;
+	}
+	return s->cur != s->from;
+}
+
+#endif
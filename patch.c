@@ -0,0 +1,91 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "patch.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+
+/* -------------------------------------------------------------------------------------
+	openBank: the header is checked against the size of the file before anything is
+	read from the patches. Locking may fail for lack of privileges, then the pages
+	stay in memory only as long as the system keeps them.
+------------------------------------------------------------------------------------- */
+PatchBank *openBank(const char *path)
+{
+	PatchBank *bank;
+	const BankHeader *h;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(BankHeader)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	h = map;
+	if (memcmp(h->magic, BANK_MAGIC, 8) != 0 || h->version != BANK_VERSION
+	    || h->patchSize != sizeof(Patch)
+	    || h->count > (st.st_size - sizeof(BankHeader)) / sizeof(Patch)) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	madvise(map, st.st_size, MADV_WILLNEED);
+	mlock(map, st.st_size);
+
+	bank = malloc(sizeof(PatchBank));
+	bank->map = map;
+	bank->size = st.st_size;
+	bank->count = h->count;
+	bank->patch = (const Patch*)(h + 1);
+	return bank;
+}
+
+void closeBank(PatchBank *bank)
+{
+	if (bank == NULL)
+		return;
+	munlock(bank->map, bank->size);
+	munmap(bank->map, bank->size);
+	free(bank);
+}
+
+/* -------------------------------------------------------------------------------------
+	writeBank
+------------------------------------------------------------------------------------- */
+int writeBank(const char *path, const Patch *patch, int count)
+{
+	BankHeader h;
+	FILE *f;
+	int ok;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BANK_MAGIC, 8);
+	h.version = BANK_VERSION;
+	h.count = count;
+	h.patchSize = sizeof(Patch);
+
+	f = fopen(path, "wb");
+	if (f == NULL)
+		return 1;
+	ok = fwrite(&h, sizeof(h), 1, f) == 1
+	     && fwrite(patch, sizeof(Patch), count, f) == (size_t)count;
+	if (fclose(f) != 0)
+		ok = 0;
+	return !ok;
+}
@@ -0,0 +1,97 @@
+
+/*-----------------------------------------------------------------------------------
+    PATCH
+
+    Patch banks: files of complete part sounds (waveform, level, pan, envelopes,
+	lfos, filter, sample playback, modulation routing, controller map and effect sends) that midi
+	program change selects from.
+
+	-a bank is a header followed by an array of fixed-size patches, in the byte
+	 order of the machine. It is mapped into memory as it is, so opening a bank
+	 of any size takes no parsing, and a patch is used straight from the map
+	-the pages of the bank are read in and locked when it is opened, so that a
+	 program change on the audio thread does no file i/o
+	-values in a patch are not trusted, they are clamped when the patch is
+	 applied to a part
+	-patch number is (bank select msb * 128 + lsb) * 128 + program
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef PATCH_H
+#define PATCH_H
+
+#include "envelope.h"
+#include "modulation.h"
+#include "fx.h"
+
+#define BANK_MAGIC   "ESP1BANK"
+#define BANK_VERSION 4
+
+#define PATCH_NAME 24
+
+/* one sound. Envelope values are ATT, DEC, SUS, REL and the shape */
+typedef struct
+{
+	char  name[PATCH_NAME];   /* zero-terminated */
+	int   waveform;
+	float gain;               /* 0-1 */
+	int   pan;                /* 0-127, 64 is the middle */
+	float pw;                 /* pulse width, percent */
+	int   env[NUM_ENVS][5];
+	struct {
+		int   shape;
+		float rate;
+	} lfo[NUM_LFOS];
+	ModSlot slot[MOD_SLOTS];
+	unsigned char ctdest[128]; /* controller destinations */
+	float send[NUM_FX];        /* effect sends, 0-1 */
+	int   filter;              /* FILTER_OFF or FILTER_LP */
+	float cutoff;              /* midi note scale, 0-127 */
+	float resonance;           /* 0-1 */
+	float envAmount;           /* semitones the filter envelope adds to the cutoff, -96 - 96 */
+	float keytrack;            /* how much the cutoff follows the note, 0-1 */
+	int   sampled;             /* plays the sampled instrument instead of the oscillator, if one is loaded */
+} Patch;
+
+typedef struct
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int count;       /* number of patches */
+	unsigned int patchSize;   /* sizeof(Patch) of the program that wrote the bank */
+	unsigned int reserved[3];
+} BankHeader;
+
+typedef struct
+{
+	void  *map;
+	size_t size;
+	int    count;
+	const Patch *patch;
+} PatchBank;
+
+
+/*---------------------------------------------------------------------------
+	openBank maps a bank file into memory. Returns NULL if the file cannot be
+	read or is not a bank of this version.
+------------------------------------------------------------------------------*/
+PatchBank *openBank(const char *path);
+
+void closeBank(PatchBank *bank);
+
+/*---------------------------------------------------------------------------
+	bankPatch returns patch number n, or NULL if the bank has no such patch
+------------------------------------------------------------------------------*/
+static inline const Patch *bankPatch(const PatchBank *bank, int n)
+{
+	if (bank == NULL || n < 0 || n >= bank->count)
+		return NULL;
+	return &bank->patch[n];
+}
+
+/*---------------------------------------------------------------------------
+	writeBank writes count patches into a bank file. Returns 0 on success.
+------------------------------------------------------------------------------*/
+int writeBank(const char *path, const Patch *patch, int count);
+
+#endif
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE   /* SCHED_IDLE */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include "recorder.h"
+#include "wavfile.h"
+
+/* interleaved stereo frames */
+#define FRAME_BYTES (2 * sizeof(float))
+#define CHUNK_FRAMES (RECORD_CHUNK / FRAME_BYTES)
+
+
+/* -------------------------------------------------------------------------------------
+	writeChunk: the frames gathered in the chunk are written into the file. After a
+	failed write the frames are only counted as dropped.
+------------------------------------------------------------------------------------- */
+static void writeChunk(Recorder *r)
+{
+	const char *p = (const char *)r->chunk;
+	size_t left = r->fill * FRAME_BYTES;
+	ssize_t n;
+
+	while (!r->failed && left > 0) {
+		n = write(r->fd, p, left);
+		if (n <= 0)
+			r->failed = 1;
+		else {
+			p += n;
+			left -= n;
+		}
+	}
+	if (r->failed)
+		atomic_fetch_add(&r->dropped, r->fill);
+	else
+		r->frames += r->fill;
+	r->fill = 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	drain: everything in the ring is taken into the chunk, and each full chunk written
+------------------------------------------------------------------------------------- */
+static void drain(Recorder *r)
+{
+	unsigned int n;
+
+	do {
+		n = ringRead(r->ring, r->chunk + 2 * r->fill, CHUNK_FRAMES - r->fill);
+		r->fill += n;
+		if (r->fill == CHUNK_FRAMES)
+			writeChunk(r);
+	} while (n > 0);
+}
+
+/* -------------------------------------------------------------------------------------
+	openTake: a file named by the pattern is created with an empty header.
+	Returns 0 on success.
+------------------------------------------------------------------------------------- */
+static int openTake(Recorder *r)
+{
+	unsigned char h[RECORD_HEADER];
+	time_t now = time(NULL);
+	struct tm tm;
+
+	localtime_r(&now, &tm);
+	if (strftime(r->path, sizeof(r->path), r->pattern, &tm) == 0)
+		return 1;
+	r->fd = open(r->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (r->fd < 0)
+		return 1;
+	wav64Header(h, RECORD_HEADER, r->rate, 2, 0);
+	if (write(r->fd, h, RECORD_HEADER) != RECORD_HEADER) {
+		close(r->fd);
+		return 1;
+	}
+	r->fill = 0;
+	r->frames = 0;
+	r->failed = 0;
+	r->dropStart = atomic_load(&r->dropped);
+	printf("Recording to %s\n", r->path);
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	closeTake: the rest of the frames are written, and the header is written again
+	with the length. A take that never started is removed.
+------------------------------------------------------------------------------------- */
+static void closeTake(Recorder *r, int started)
+{
+	unsigned char h[RECORD_HEADER];
+	unsigned long lost;
+
+	if (r->fill > 0)
+		writeChunk(r);
+	wav64Header(h, RECORD_HEADER, r->rate, 2, r->frames);
+	if (pwrite(r->fd, h, RECORD_HEADER, 0) != RECORD_HEADER)
+		r->failed = 1;
+	close(r->fd);
+	if (!started) {
+		unlink(r->path);
+		return;
+	}
+	atomic_fetch_add(&r->takes, 1);
+	lost = atomic_load(&r->dropped) - r->dropStart;
+	printf("Recorded %s: %.1f s", r->path, (double)r->frames / r->rate);
+	if (lost > 0)
+		printf(", %lu frames dropped", lost);
+	if (r->failed)
+		printf(", writing failed");
+	printf("\n");
+}
+
+/* -------------------------------------------------------------------------------------
+	writer: thread function. It opens a file when recording is asked for, writes what
+	the audio thread copies, and closes the file when the audio thread has stopped.
+------------------------------------------------------------------------------------- */
+static void *writer(void *arg)
+{
+	Recorder *r = (Recorder *)arg;
+	struct timespec idle = { 0, RECORD_IDLE_NS };
+	int state, expect;
+
+	while (atomic_load_explicit(&r->running, memory_order_acquire)) {
+		state = atomic_load_explicit(&r->state, memory_order_acquire);
+		if (state == RECORD_IDLE && atomic_load(&r->want)) {
+			if (openTake(r) == 0) {
+				ringReset(r->ring);
+				atomic_store_explicit(&r->state, RECORD_OPEN, memory_order_release);
+			}
+			else {
+				printf("Cannot record to %s\n", r->path);
+				atomic_store(&r->want, 0);
+			}
+		}
+		else if (state == RECORD_OPEN && !atomic_load(&r->want)) {
+			/* stopped before the audio thread started, unless it starts right now */
+			expect = RECORD_OPEN;
+			if (atomic_compare_exchange_strong(&r->state, &expect, RECORD_IDLE))
+				closeTake(r, 0);
+		}
+		else if (state == RECORD_RUN || state == RECORD_CLOSE) {
+			drain(r);
+			if (state == RECORD_CLOSE) {
+				closeTake(r, 1);
+				atomic_store_explicit(&r->state, RECORD_IDLE, memory_order_release);
+			}
+		}
+		nanosleep(&idle, NULL);
+	}
+
+	/* the audio has stopped, so a take still going on is complete in the ring */
+	state = atomic_load_explicit(&r->state, memory_order_acquire);
+	if (state != RECORD_IDLE) {
+		drain(r);
+		closeTake(r, state != RECORD_OPEN);
+		atomic_store(&r->state, RECORD_IDLE);
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	startWriter: the writer runs only when the cpu has nothing else to do, if the system
+	allows it, so that writing to disk never competes with the synth threads
+------------------------------------------------------------------------------------- */
+static int startWriter(Recorder *r)
+{
+#ifdef SCHED_IDLE
+	struct sched_param param = { 0 };
+#endif
+
+	if (pthread_create(&r->thread, NULL, writer, r) != 0)
+		return 1;
+#ifdef SCHED_IDLE
+	/* set after the start, as pthread attributes take only the real-time policies.
+	   Where the system refuses, the writer runs at normal priority */
+	pthread_setschedparam(r->thread, SCHED_IDLE, &param);
+#endif
+	return 0;
+}
+
+Recorder *createRecorder(unsigned int rate, const char *pattern)
+{
+	Recorder *r = (Recorder *)calloc(1, sizeof(Recorder));
+	void *chunk;
+
+	if (r == NULL)
+		return NULL;
+	r->rate = rate;
+	r->pattern = pattern;
+	r->ring = createRingBuffer(RECORD_SECONDS * rate, FRAME_BYTES);
+	if (r->ring == NULL || posix_memalign(&chunk, RECORD_HEADER, RECORD_CHUNK) != 0) {
+		destroyRingBuffer(r->ring);
+		free(r);
+		return NULL;
+	}
+	r->chunk = (float *)chunk;
+	atomic_store(&r->running, 1);
+	if (startWriter(r) != 0) {
+		destroyRingBuffer(r->ring);
+		free(r->chunk);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+void destroyRecorder(Recorder *r)
+{
+	if (r == NULL)
+		return;
+	atomic_store_explicit(&r->running, 0, memory_order_release);
+	pthread_join(r->thread, NULL);
+	destroyRingBuffer(r->ring);
+	free(r->chunk);
+	free(r);
+}
+
+void recorderSet(Recorder *r, int on)
+{
+	atomic_store(&r->want, on);
+}
+
+int recorderOn(Recorder *r)
+{
+	return atomic_load(&r->want);
+}
+
+void recorderBlock(Recorder *r, const float *out, unsigned long frames)
+{
+	int state = atomic_load_explicit(&r->state, memory_order_acquire);
+	int want = atomic_load_explicit(&r->want, memory_order_relaxed);
+
+	if (state == RECORD_OPEN && want
+	    && atomic_compare_exchange_strong(&r->state, &state, RECORD_RUN))
+		state = RECORD_RUN;
+	if (state != RECORD_RUN)
+		return;
+	if (!want) {
+		atomic_store_explicit(&r->state, RECORD_CLOSE, memory_order_release);
+		return;
+	}
+	/* a block is copied whole or not at all */
+	if (ringSpace(r->ring) < frames)
+		atomic_fetch_add(&r->dropped, frames);
+	else
+		ringWrite(r->ring, out, frames);
+}
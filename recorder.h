@@ -0,0 +1,101 @@
+
+/*-----------------------------------------------------------------------------------
+    RECORDER
+
+    Records the output of the synth into WAV files, exactly as the audio callback
+	made it, without a loopback through the sound card.
+
+	-the audio thread only copies each block into a ring of RECORD_SECONDS of
+	 frames. It never opens, writes or closes a file
+	-a writer thread takes the frames from the ring and writes them in aligned
+	 RECORD_CHUNK byte pieces. The header is RECORD_HEADER bytes, so the writes
+	 also fall on aligned offsets of the file. The writer runs at idle priority
+	 where the system has it, so it gets the cpu only when the synth threads
+	 leave it free
+	-frames that do not fit into the ring, because the disk has fallen behind by
+	 the length of the ring, are dropped and counted
+	-the files are float WAV, and RF64 when they grow over 4 GB
+	-recording is started and stopped with recorderSet from any thread. The
+	 threads hand the take over with its state: the writer opens the file and
+	 sets OPEN, the audio thread starts copying at the next block and sets RUN,
+	 and stops copying and sets CLOSE, after which the writer writes the rest
+	 and closes the file. Each state is changed by one side only, so no locks
+	 are needed and the first and last blocks of a take are always whole
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ringbuf.h"
+
+/* length of the ring, bytes written at once, and bytes of the file header */
+#define RECORD_SECONDS 4
+#define RECORD_CHUNK   262144
+#define RECORD_HEADER  4096
+
+/* how long the writer sleeps between rounds (nanoseconds) */
+#define RECORD_IDLE_NS 20000000
+
+/* controller that starts (value 64-127) and stops (0-63) recording, on any channel */
+#define RECORD_CC 85
+
+/* states of a take */
+#define RECORD_IDLE  0   /* no file */
+#define RECORD_OPEN  1   /* the writer has opened a file, the audio thread may start */
+#define RECORD_RUN   2   /* the audio thread copies its blocks */
+#define RECORD_CLOSE 3   /* the audio thread has stopped, the writer closes the file */
+
+typedef struct
+{
+	unsigned int rate;
+	const char *pattern;        /* strftime pattern of the file names */
+	RingBuffer *ring;           /* stereo frames */
+	atomic_int want;            /* recording requested */
+	atomic_int state;
+
+	/* used by the writer thread */
+	int   fd;
+	char  path[1024];
+	float *chunk;               /* aligned to RECORD_HEADER */
+	unsigned long fill;         /* frames in chunk */
+	unsigned long long frames;  /* frames written into the file */
+	unsigned long dropStart;    /* overflow of the ring when the take started */
+	int   failed;               /* a write failed, the rest of the take is lost */
+
+	atomic_ulong takes;
+	atomic_ulong dropped;       /* frames lost in all takes, to a full ring or failed writes */
+	atomic_int running;
+	pthread_t thread;
+} Recorder;
+
+
+/*---------------------------------------------------------------------------
+	createRecorder reserves the ring for rate and starts the writer thread.
+	The files are named by pattern with strftime, at the time each take
+	starts. Returns NULL if there is not enough memory.
+------------------------------------------------------------------------------*/
+Recorder *createRecorder(unsigned int rate, const char *pattern);
+
+/*---------------------------------------------------------------------------
+	destroyRecorder ends a take that is going on and stops the writer. The
+	audio must be stopped.
+------------------------------------------------------------------------------*/
+void destroyRecorder(Recorder *r);
+
+/*---------------------------------------------------------------------------
+	recorderSet starts (on = 1) or stops recording. recorderOn tells if
+	recording is requested.
+------------------------------------------------------------------------------*/
+void recorderSet(Recorder *r, int on);
+int recorderOn(Recorder *r);
+
+/*---------------------------------------------------------------------------
+	recorderBlock copies frames of the interleaved stereo output into the
+	ring while a take is going on. Called by the audio thread after each block.
+------------------------------------------------------------------------------*/
+void recorderBlock(Recorder *r, const float *out, unsigned long frames);
+
+#endif
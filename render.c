@@ -0,0 +1,210 @@
+/*-----------------------------------------------------------------------------------------
+
+	ESP-1 offline renderer
+
+	Renders a Standard MIDI File into a WAV file with the same synthesis engine that
+	ESP-1 uses in real time. No audio or midi devices are needed, and the rendering
+	runs as fast as the processor allows. When finished, the real-time factor is
+	reported: how many seconds of audio were rendered per second of processor time.
+
+	With -g the governor runs as it does in real time, against a deadline of the given
+	fraction of each block's duration, and its decisions are printed. A small budget
+	shows how the synth degrades on a slower machine.
+
+	With -i the parts play a sampled instrument (.sfz). The renderer waits for the
+	disk before each block, so the samples never run dry however fast it renders.
+
+	usage: esp1render [-r samplerate] [-b framecount] [-w waveform] [-u wavefile]
+	                  [-s scale.scl] [-k keymap.kbm] [-c control rate] [-t tail seconds]
+	                  [-g budget] [-p bank] [-i instrument.sfz] in.mid out.wav
+
+-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "synth.h"
+#include "midifile.h"
+#include "wavfile.h"
+#include "governor.h"
+
+/* how long the release tail may continue after the last event (seconds) */
+#define DEFAULT_TAIL 10.0
+
+
+/* ------------------------------------------------------------------------------------------
+	seconds: monotonic clock in seconds
+--------------------------------------------------------------------------------------------*/
+static double seconds()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: esp1render [-r samplerate] [-b framecount] [-w waveform 1-5] [-u wavefile]\n"
+	                "                  [-s scale.scl] [-k keymap.kbm] [-c control rate] [-t tail seconds]\n"
+	                "                  [-g budget 0-1] [-p patch bank] [-i instrument.sfz] in.mid out.wav\n");
+}
+
+/*-------------------------------------------------------------------------------------------
+  main
+---------------------------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	int opt, waveform = PUL, nev, ctrlRate = CTRL_RATE, i, level;
+	long next = 0;
+	double tail = DEFAULT_TAIL, start, renderTime = 0, t, length, budget = 0;
+	Governor *governor = NULL;
+	GovDecision d;
+	const char *userWave = NULL, *scl = NULL, *kbm = NULL, *bankFile = NULL, *sfz = NULL;
+	PatchBank *bank = NULL;
+	Sampler *sampler = NULL;
+	unsigned long long frame = 0, lastFrame, evFrame;
+	SynthData *synth;
+	MidiFile *mf;
+	WavFile *wav;
+	PmEvent *events;
+	unsigned long *at;
+	float *out;
+
+	samplerate = 44100;
+	framecount = 128;
+
+	while ((opt = getopt(argc, argv, "r:b:w:u:s:k:c:t:g:p:i:")) != -1) {
+		switch (opt) {
+			case 'r': samplerate = atoi(optarg); break;
+			case 'b': framecount = atoi(optarg); break;
+			case 'w': waveform = atoi(optarg); break;
+			case 'u': userWave = optarg; break;
+			case 's': scl = optarg; break;
+			case 'k': kbm = optarg; break;
+			case 'c': ctrlRate = atoi(optarg); break;
+			case 't': tail = atof(optarg); break;
+			case 'g': budget = atof(optarg); break;
+			case 'p': bankFile = optarg; break;
+			case 'i': sfz = optarg; break;
+			default: usage(); return 1;
+		}
+	}
+	if (argc - optind != 2 || samplerate < 8000 || framecount < 1 || waveform < 1 || waveform > NUM_WAVES
+	    || budget < 0 || budget > 1) {
+		usage();
+		return 1;
+	}
+
+	mf = readMidiFile(argv[optind]);
+	if (mf == NULL) {
+		fprintf(stderr, "Cannot read midi file %s\n", argv[optind]);
+		return 1;
+	}
+	wav = openWav(argv[optind + 1], samplerate, 2);
+	if (wav == NULL) {
+		fprintf(stderr, "Cannot create %s\n", argv[optind + 1]);
+		freeMidiFile(mf);
+		return 1;
+	}
+
+	synth = initSynthData();
+	if (userWave != NULL && loadWavetable(synth->ad->waves, userWave) != 0)
+		fprintf(stderr, "Cannot load waveform from %s\n", userWave);
+	if (scl != NULL && loadScala(synth->ad->tuning, scl, kbm) != 0)
+		fprintf(stderr, "Cannot load tuning from %s\n", scl);
+	if (bankFile != NULL) {
+		bank = openBank(bankFile);
+		if (bank == NULL)
+			fprintf(stderr, "Cannot open patch bank %s\n", bankFile);
+		synth->ad->bank = bank;
+	}
+	if (sfz != NULL) {
+		sampler = loadSampler(sfz);
+		if (sampler == NULL)
+			fprintf(stderr, "Cannot load instrument %s\n", sfz);
+		else if (sampler->failed > 0)
+			fprintf(stderr, "%d samples of %s could not be read\n", sampler->failed, sfz);
+		synth->ad->sampler = sampler;
+	}
+	for (i = 0; i < NUM_PARTS; i++)
+		modSetRate(synth->ad->part[i].mod, ctrlRate);
+	paramSet(synth->params, ALL_PARTS, PARAM_WAVEFORM, waveform);
+	if (budget > 0)
+		governor = createGovernor(NUM_QUALITY, samplerate);
+
+	/* all buffers are reserved before rendering, the events of one block can be at most all of them */
+	out = malloc(framecount * 2 * sizeof(float));
+	events = malloc((mf->count + 1) * sizeof(PmEvent));
+	at = malloc((mf->count + 1) * sizeof(unsigned long));
+	lastFrame = (unsigned long long)(mf->length * samplerate);
+
+	start = seconds();
+	for (;;) {
+		/* the events of this block, placed on their exact frames */
+		nev = 0;
+		while (next < mf->count) {
+			evFrame = (unsigned long long)(mf->events[next].time * samplerate + 0.5);
+			if (evFrame >= frame + framecount)
+				break;
+			events[nev] = mf->events[next].ev;
+			at[nev] = evFrame - frame;
+			nev++;
+			next++;
+		}
+
+		if (sampler != NULL)
+			samplerSync(sampler);
+		t = seconds();
+		renderEvents(synth, out, framecount, events, at, nev);
+		t = seconds() - t;
+		renderTime += t;
+
+		if (governor != NULL) {
+			level = govUpdate(governor, t * samplerate / (framecount * budget), framecount);
+			if (level >= 0)
+				setQuality(synth, level);
+		}
+
+		if (writeWav(wav, out, framecount) != 0) {
+			fprintf(stderr, "Cannot write %s\n", argv[optind + 1]);
+			break;
+		}
+		frame += framecount;
+
+		/* after the last event, stop when all voices and effects are silent or the tail
+		   is used up */
+		if (next >= mf->count &&
+		   ((synth->ad->voices->numActive == 0 && fxActive(synth->ad->fx) == 0)
+		    || frame >= lastFrame + tail * samplerate))
+			break;
+	}
+	t = seconds() - start;
+
+	length = (double)frame / samplerate;
+	printf("Rendered %.2f s of audio, %d events, %s kernels\n", length, mf->count, dsp.name);
+	printf("Render time %.3f s, real-time factor %.1f\n", renderTime, renderTime > 0 ? length / renderTime : 0);
+	printf("Total time %.3f s with file output, real-time factor %.1f\n", t, t > 0 ? length / t : 0);
+
+	if (sampler != NULL)
+		printf("Instrument: %d zones, %.1f MB in memory, %lu underruns, %lu notes without a stream\n",
+		       sampler->numZones, sampler->memory / 1048576.0, (unsigned long)sampler->underruns,
+		       (unsigned long)sampler->noStream);
+
+	if (governor != NULL) {
+		while (govDecisions(governor, &d, 1) == 1)
+			printf("%9.3f s  quality %d -> %d, load %.0f %%, average %.0f %%\n",
+			       d.time, d.from, d.to, 100 * d.load, 100 * d.avg);
+		destroyGovernor(governor);
+	}
+
+	closeWav(wav);
+	freeMidiFile(mf);
+	freeSynthData(synth);
+	closeBank(bank);
+	destroySampler(sampler);
+	free(out);
+	free(events);
+	free(at);
+	return 0;
+}
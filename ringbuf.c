@@ -0,0 +1,152 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "ringbuf.h"
+
+
+/* -------------------------------------------------------------------------------------
+	createRingBuffer
+------------------------------------------------------------------------------------- */
+RingBuffer *createRingBuffer(unsigned int capacity, unsigned int elemSize)
+{
+	RingBuffer *rb;
+	unsigned int size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	/* the structure must be aligned so that the two sides really are on separate cache lines */
+	if (posix_memalign((void**)&rb, CACHE_LINE, sizeof(RingBuffer)) != 0)
+		return NULL;
+	if (posix_memalign((void**)&rb->buf, CACHE_LINE, (size_t)size * elemSize) != 0) {
+		free(rb);
+		return NULL;
+	}
+
+	atomic_init(&rb->head, 0);
+	atomic_init(&rb->tail, 0);
+	atomic_init(&rb->overflow, 0);
+	rb->cachedTail = 0;
+	rb->cachedHead = 0;
+	rb->size = size;
+	rb->mask = size - 1;
+	rb->elemSize = elemSize;
+	return rb;
+}
+
+/* -------------------------------------------------------------------------------------
+	destroyRingBuffer
+------------------------------------------------------------------------------------- */
+void destroyRingBuffer(RingBuffer *rb)
+{
+	if (rb == NULL)
+		return;
+	free(rb->buf);
+	free(rb);
+}
+
+/* -------------------------------------------------------------------------------------
+	copyIn / copyOut: copy count elements starting at index, wrapping around the end
+	of the buffer if needed
+------------------------------------------------------------------------------------- */
+static void copyIn(RingBuffer *rb, unsigned int index, const char *src, unsigned int count)
+{
+	unsigned int pos = index & rb->mask;
+	unsigned int first = rb->size - pos;
+
+	if (first > count)
+		first = count;
+	memcpy(rb->buf + (size_t)pos * rb->elemSize, src, (size_t)first * rb->elemSize);
+	if (count > first)
+		memcpy(rb->buf, src + (size_t)first * rb->elemSize, (size_t)(count - first) * rb->elemSize);
+}
+
+static void copyOut(RingBuffer *rb, unsigned int index, char *dst, unsigned int count)
+{
+	unsigned int pos = index & rb->mask;
+	unsigned int first = rb->size - pos;
+
+	if (first > count)
+		first = count;
+	memcpy(dst, rb->buf + (size_t)pos * rb->elemSize, (size_t)first * rb->elemSize);
+	if (count > first)
+		memcpy(dst + (size_t)first * rb->elemSize, rb->buf, (size_t)(count - first) * rb->elemSize);
+}
+
+/* -------------------------------------------------------------------------------------
+	ringWrite: the indices run freely and are masked only when used, so the
+	difference head - tail is always the number of elements in the buffer.
+------------------------------------------------------------------------------------- */
+unsigned int ringWrite(RingBuffer *rb, const void *src, unsigned int count)
+{
+	unsigned int head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+	unsigned int space = rb->size - (head - rb->cachedTail);
+
+	/* refresh the cached tail only if it does not give enough room */
+	if (space < count) {
+		rb->cachedTail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+		space = rb->size - (head - rb->cachedTail);
+	}
+	if (count > space) {
+		atomic_fetch_add_explicit(&rb->overflow, count - space, memory_order_relaxed);
+		count = space;
+	}
+	if (count == 0)
+		return 0;
+
+	copyIn(rb, head, src, count);
+	atomic_store_explicit(&rb->head, head + count, memory_order_release);
+	return count;
+}
+
+/* -------------------------------------------------------------------------------------
+	ringRead
+------------------------------------------------------------------------------------- */
+unsigned int ringRead(RingBuffer *rb, void *dst, unsigned int max)
+{
+	unsigned int tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+	unsigned int avail = rb->cachedHead - tail;
+
+	if (avail < max) {
+		rb->cachedHead = atomic_load_explicit(&rb->head, memory_order_acquire);
+		avail = rb->cachedHead - tail;
+	}
+	if (max > avail)
+		max = avail;
+	if (max == 0)
+		return 0;
+
+	copyOut(rb, tail, dst, max);
+	atomic_store_explicit(&rb->tail, tail + max, memory_order_release);
+	return max;
+}
+
+/* -------------------------------------------------------------------------------------
+	ringReset
+------------------------------------------------------------------------------------- */
+void ringReset(RingBuffer *rb)
+{
+	atomic_store_explicit(&rb->head, 0, memory_order_relaxed);
+	atomic_store_explicit(&rb->tail, 0, memory_order_relaxed);
+	rb->cachedTail = 0;
+	rb->cachedHead = 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	ringCount, ringSpace, ringOverflow
+------------------------------------------------------------------------------------- */
+unsigned int ringCount(RingBuffer *rb)
+{
+	return atomic_load_explicit(&rb->head, memory_order_acquire) -
+	       atomic_load_explicit(&rb->tail, memory_order_acquire);
+}
+
+unsigned int ringSpace(RingBuffer *rb)
+{
+	return rb->size - ringCount(rb);
+}
+
+unsigned long ringOverflow(RingBuffer *rb)
+{
+	return atomic_load_explicit(&rb->overflow, memory_order_relaxed);
+}
@@ -0,0 +1,88 @@
+
+/*-----------------------------------------------------------------------------------
+    RINGBUF
+
+    Wait-free single producer / single consumer ring buffer for passing fixed size
+	elements (midi events, parameter changes, audio frames) between two threads.
+
+	-exactly one thread may write and exactly one thread may read
+	-the producer and consumer indices are kept on separate cache lines, and each
+	 side keeps a cached copy of the other side's index, so the two threads touch
+	 shared cache lines only when the cached value runs out
+	-elements that do not fit are not written, they are counted as overflow
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdatomic.h>
+
+#if defined(__APPLE__) && defined(__aarch64__)
+#define CACHE_LINE 128
+#else
+#define CACHE_LINE 64
+#endif
+
+typedef struct
+{
+	/* producer side */
+	_Alignas(CACHE_LINE) atomic_uint head;   /* next position to write */
+	unsigned int  cachedTail;                /* last seen value of tail */
+	atomic_ulong  overflow;                  /* elements dropped because the buffer was full */
+
+	/* consumer side */
+	_Alignas(CACHE_LINE) atomic_uint tail;   /* next position to read */
+	unsigned int  cachedHead;                /* last seen value of head */
+
+	/* constant after creation */
+	_Alignas(CACHE_LINE) unsigned int size;  /* capacity, a power of two */
+	unsigned int  mask;
+	unsigned int  elemSize;
+	char         *buf;
+} RingBuffer;
+
+
+/*---------------------------------------------------------------------------
+	createRingBuffer reserves a buffer for at least capacity elements of
+	elemSize bytes. The capacity is rounded up to a power of two.
+------------------------------------------------------------------------------*/
+RingBuffer *createRingBuffer(unsigned int capacity, unsigned int elemSize);
+
+/*---------------------------------------------------------------------------
+	destroyRingBuffer
+------------------------------------------------------------------------------*/
+void destroyRingBuffer(RingBuffer *rb);
+
+/* -----------------------------------------------------------------------------
+	ringWrite copies up to count elements from src into the buffer and returns
+	the number written. Elements that did not fit are added to the overflow
+	count. Called only by the producer.
+------------------------------------------------------------------------------*/
+unsigned int ringWrite(RingBuffer *rb, const void *src, unsigned int count);
+
+/* -----------------------------------------------------------------------------
+	ringRead copies up to max elements into dst and returns the number read.
+	Called only by the consumer.
+------------------------------------------------------------------------------*/
+unsigned int ringRead(RingBuffer *rb, void *dst, unsigned int max);
+
+/* -----------------------------------------------------------------------------
+	ringCount returns the number of elements waiting to be read
+	ringSpace returns the number of elements that can be written
+------------------------------------------------------------------------------*/
+unsigned int ringCount(RingBuffer *rb);
+unsigned int ringSpace(RingBuffer *rb);
+
+/* -----------------------------------------------------------------------------
+	ringReset empties the buffer. Only while neither side is using it, the
+	threads must hand the buffer over with some other synchronization.
+------------------------------------------------------------------------------*/
+void ringReset(RingBuffer *rb);
+
+/* -----------------------------------------------------------------------------
+	ringOverflow returns the number of elements dropped so far
+------------------------------------------------------------------------------*/
+unsigned long ringOverflow(RingBuffer *rb);
+
+#endif
@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sampler.h"
+
+/* longest line and path of an .sfz file */
+#define SFZ_LINE 1024
+
+/* bytes of one frame of the largest sample format, 2 channels of 32 bits */
+#define MAX_FRAME_BYTES 8
+
+
+/* -------------------------------------------------------------------------------------
+	toMono: frames of a sample are converted to float and the channels averaged
+------------------------------------------------------------------------------------- */
+static void toMono(const Zone *z, const unsigned char *src, float *dst, int frames)
+{
+	int i, c, v;
+	float sum, f;
+
+	for (i = 0; i < frames; i++) {
+		sum = 0;
+		for (c = 0; c < z->channels; c++) {
+			if (z->isFloat)
+				memcpy(&f, src, 4);
+			else if (z->bits == 16)
+				f = (short)(src[0] | src[1] << 8) * (1.0f / 32768);
+			else {
+				v = (int)((unsigned int)src[0] << 8 | (unsigned int)src[1] << 16 | (unsigned int)src[2] << 24);
+				f = v * (1.0f / 2147483648.0f);
+			}
+			sum += f;
+			src += z->bits / 8;
+		}
+		dst[i] = (z->channels == 2) ? 0.5f * sum : sum;
+	}
+}
+
+static unsigned int le16(const unsigned char *b) { return b[0] | b[1] << 8; }
+static unsigned int le32(const unsigned char *b) { return b[0] | b[1] << 8 | b[2] << 16 | (unsigned int)b[3] << 24; }
+
+/* -------------------------------------------------------------------------------------
+	readWav: the format and the data chunk of the sample are found, and its attack is
+	read. Returns 0 on success.
+------------------------------------------------------------------------------------- */
+static int readWav(Zone *z)
+{
+	FILE *f = fopen(z->path, "rb");
+	unsigned char h[40], *raw;
+	unsigned int size, format = 0;
+	int frameBytes;
+
+	if (f == NULL)
+		return 1;
+	if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(h + 8, "WAVE", 4) != 0) {
+		fclose(f);
+		return 1;
+	}
+	z->frames = 0;
+	while (fread(h, 1, 8, f) == 8) {
+		size = le32(h + 4);
+		if (memcmp(h, "fmt ", 4) == 0 && size >= 16 && size <= sizeof(h)) {
+			if (fread(h, 1, size, f) != size)
+				break;
+			format = le16(h);
+			z->channels = le16(h + 2);
+			z->rate = le32(h + 4);
+			z->bits = le16(h + 14);
+			if (format == 0xFFFE && size >= 26)   /* extensible, the format is in the sub format */
+				format = le16(h + 24);
+			/* checked before the data chunk, whose length is divided by the frame size */
+			if (z->rate == 0 || z->channels < 1 || z->channels > 2
+			    || !((format == 1 && (z->bits == 16 || z->bits == 24)) || (format == 3 && z->bits == 32)))
+				break;
+			if (size & 1)
+				fseek(f, 1, SEEK_CUR);
+		}
+		else if (memcmp(h, "data", 4) == 0 && format != 0) {
+			z->offset = ftell(f);
+			z->frames = size / (z->channels * (z->bits / 8));
+			break;
+		}
+		else
+			fseek(f, size + (size & 1), SEEK_CUR);
+	}
+	z->isFloat = (format == 3);
+	if (z->frames == 0 || z->rate == 0 || z->channels < 1 || z->channels > 2
+	    || !((format == 1 && (z->bits == 16 || z->bits == 24)) || (format == 3 && z->bits == 32))) {
+		fclose(f);
+		return 1;
+	}
+
+	frameBytes = z->channels * (z->bits / 8);
+	z->attackLen = (z->frames < SAMPLE_ATTACK) ? z->frames : SAMPLE_ATTACK;
+	z->attack = malloc(z->attackLen * sizeof(float));
+	raw = malloc(z->attackLen * frameBytes);
+	if (z->attack == NULL || raw == NULL || fread(raw, frameBytes, z->attackLen, f) != (size_t)z->attackLen) {
+		free(raw);
+		free(z->attack);
+		fclose(f);
+		return 1;
+	}
+	toMono(z, raw, z->attack, z->attackLen);
+	free(raw);
+	fclose(f);
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	zoneDefaults: all keys and velocities, root at middle C
+------------------------------------------------------------------------------------- */
+static void zoneDefaults(Zone *z)
+{
+	memset(z, 0, sizeof(Zone));
+	z->hikey = 127;
+	z->lovel = 1;
+	z->hivel = 127;
+	z->root = 60;
+}
+
+/* -------------------------------------------------------------------------------------
+	setOpcode: an opcode of a region or group. The key opcodes set the key range and
+	the root together.
+------------------------------------------------------------------------------------- */
+static void setOpcode(Zone *z, const char *name, const char *value, const char *dir)
+{
+	int v = atoi(value);
+
+	if (strcmp(name, "sample") == 0) {
+		free(z->path);
+		z->path = malloc(strlen(dir) + strlen(value) + 1);
+		sprintf(z->path, "%s%s", (value[0] == '/') ? "" : dir, value);
+	}
+	else if (strcmp(name, "key") == 0)
+		z->lokey = z->hikey = z->root = v;
+	else if (strcmp(name, "lokey") == 0)
+		z->lokey = v;
+	else if (strcmp(name, "hikey") == 0)
+		z->hikey = v;
+	else if (strcmp(name, "lovel") == 0)
+		z->lovel = v;
+	else if (strcmp(name, "hivel") == 0)
+		z->hivel = v;
+	else if (strcmp(name, "pitch_keycenter") == 0)
+		z->root = v;
+}
+
+/* -------------------------------------------------------------------------------------
+	addZone: a finished region is added if its sample can be read
+------------------------------------------------------------------------------------- */
+static void addZone(Sampler *s, Zone *z)
+{
+	if (z->path == NULL)
+		return;
+	if (readWav(z) != 0) {
+		s->failed++;
+		free(z->path);
+		return;
+	}
+	s->zone = realloc(s->zone, (s->numZones + 1) * sizeof(Zone));
+	s->zone[s->numZones++] = *z;
+	s->memory += z->attackLen * sizeof(float);
+}
+
+/* -------------------------------------------------------------------------------------
+	sampleEnd: file names may have spaces, so the value of sample goes on until the next
+	word that is an opcode (name=) or a header, or the end of the line
+------------------------------------------------------------------------------------- */
+static char *sampleEnd(char *p)
+{
+	char *q = p, *w;
+
+	while (*q != '\0') {
+		if (strchr(" \t\r\n", *q) != NULL) {
+			w = q + strspn(q, " \t\r\n");
+			if (*w == '\0' || *w == '<' || w[strspn(w, "abcdefghijklmnopqrstuvwxyz0123456789_")] == '=')
+				return q;
+			q = w;
+		}
+		else
+			q++;
+	}
+	return q;
+}
+
+/* -------------------------------------------------------------------------------------
+	parseSfz: the opcodes before the first header and of a group are the defaults of
+	the regions after them. A new group starts from the defaults again. The opcodes
+	of other headers (<global>, <master>, <control>) go to the defaults as well.
+------------------------------------------------------------------------------------- */
+static int parseSfz(Sampler *s, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[SFZ_LINE], dir[SFZ_LINE], *p, *q, *name, *c;
+	Zone group, region = { 0 }, *cur = &group;
+	int inRegion = 0;
+
+	if (f == NULL)
+		return 1;
+	snprintf(dir, sizeof(dir), "%s", path);
+	p = strrchr(dir, '/');
+	if (p != NULL)
+		p[1] = '\0';
+	else
+		dir[0] = '\0';
+
+	zoneDefaults(&group);
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((c = strstr(line, "//")) != NULL)
+			*c = '\0';
+		p = line;
+		while (*p != '\0') {
+			p += strspn(p, " \t\r\n");
+			if (*p == '\0')
+				break;
+			if (*p == '<') {
+				q = strchr(p, '>');
+				if (q == NULL)
+					break;
+				*q = '\0';
+				/* the zone owns the path now, or has freed it */
+				if (inRegion)
+					addZone(s, &region);
+				region.path = NULL;
+				inRegion = 0;
+				cur = &group;
+				if (strcmp(p + 1, "region") == 0) {
+					region = group;
+					if (group.path != NULL)
+						region.path = strdup(group.path);
+					cur = &region;
+					inRegion = 1;
+				}
+				else if (strcmp(p + 1, "group") == 0) {
+					free(group.path);
+					zoneDefaults(&group);
+				}
+				p = q + 1;
+				continue;
+			}
+			name = p;
+			q = strchr(p, '=');
+			if (q == NULL)
+				break;
+			*q = '\0';
+			p = q + 1;
+			if (strcmp(name, "sample") == 0)
+				q = sampleEnd(p);
+			else
+				q = p + strcspn(p, " \t\r\n");
+			c = (*q != '\0') ? q + 1 : q;
+			*q = '\0';
+			setOpcode(cur, name, p, dir);
+			p = c;
+		}
+	}
+	if (inRegion)
+		addZone(s, &region);
+	free(group.path);
+	fclose(f);
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	fill: one chunk of the file is read into the ring of a playing stream, if the ring
+	has room for it. Returns 1 if something was read.
+------------------------------------------------------------------------------------- */
+static int fill(Stream *st, unsigned char *raw, float *buf)
+{
+	const Zone *z = st->zone;
+	int frameBytes = z->channels * (z->bits / 8);
+	long long n;
+	ssize_t got;
+
+	if (st->fd < 0 || st->next >= z->frames || ringSpace(st->ring) < SAMPLE_CHUNK)
+		return 0;
+	n = z->frames - st->next;
+	if (n > SAMPLE_CHUNK)
+		n = SAMPLE_CHUNK;
+	got = pread(st->fd, raw, n * frameBytes, z->offset + st->next * frameBytes);
+	n = (got > 0) ? got / frameBytes : 0;
+	if (n > 0) {
+		toMono(z, raw, buf, n);
+		ringWrite(st->ring, buf, n);
+		st->next += n;
+	}
+	/* at the end, or the file has become unreadable: the voice ends when the ring is empty */
+	if (n == 0 || st->next >= z->frames) {
+		close(st->fd);
+		st->fd = -1;
+		atomic_store_explicit(&st->eof, 1, memory_order_release);
+	}
+	return 1;
+}
+
+/* -------------------------------------------------------------------------------------
+	prefetch: the thread goes through the streams, starts and frees them as the audio
+	thread asks, and reads a chunk for each playing stream that has room, so that all
+	streams are filled evenly. It sleeps only when no stream needs anything.
+------------------------------------------------------------------------------------- */
+static void *prefetch(void *arg)
+{
+	Sampler *s = arg;
+	struct timespec idle = { 0, PREFETCH_IDLE_NS };
+	unsigned char raw[SAMPLE_CHUNK * MAX_FRAME_BYTES];
+	float buf[SAMPLE_CHUNK];
+	Stream *st;
+	int i, busy, expect;
+
+	while (atomic_load_explicit(&s->running, memory_order_acquire)) {
+		busy = 0;
+		for (i = 0; i < SAMPLE_STREAMS; i++) {
+			st = &s->stream[i];
+			switch (atomic_load_explicit(&st->state, memory_order_acquire)) {
+				case STREAM_START:
+					ringReset(st->ring);
+					st->fd = open(st->zone->path, O_RDONLY);
+					st->next = st->zone->attackLen;
+					atomic_store_explicit(&st->eof, st->fd < 0, memory_order_relaxed);
+					/* the audio thread may have stopped the stream meanwhile, then it is freed */
+					expect = STREAM_START;
+					if (!atomic_compare_exchange_strong_explicit(&st->state, &expect, STREAM_PLAY,
+					                                             memory_order_acq_rel, memory_order_acquire)) {
+						if (st->fd >= 0)
+							close(st->fd);
+						st->fd = -1;
+						atomic_store_explicit(&st->state, STREAM_FREE, memory_order_release);
+					}
+					busy = 1;
+					break;
+				case STREAM_PLAY:
+					busy |= fill(st, raw, buf);
+					break;
+				case STREAM_STOP:
+					if (st->fd >= 0)
+						close(st->fd);
+					st->fd = -1;
+					atomic_store_explicit(&st->state, STREAM_FREE, memory_order_release);
+					break;
+			}
+		}
+		if (!busy)
+			nanosleep(&idle, NULL);
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	loadSampler
+------------------------------------------------------------------------------------- */
+Sampler *loadSampler(const char *path)
+{
+	Sampler *s = calloc(1, sizeof(Sampler));
+	int i;
+
+	if (s == NULL)
+		return NULL;
+	if (parseSfz(s, path) != 0 || s->numZones == 0) {
+		destroySampler(s);
+		return NULL;
+	}
+	for (i = 0; i < SAMPLE_STREAMS; i++) {
+		atomic_init(&s->stream[i].state, STREAM_FREE);
+		atomic_init(&s->stream[i].eof, 0);
+		s->stream[i].fd = -1;
+		s->stream[i].ring = createRingBuffer(SAMPLE_RING, sizeof(float));
+		s->memory += SAMPLE_RING * sizeof(float);
+	}
+	atomic_init(&s->underruns, 0);
+	atomic_init(&s->noStream, 0);
+	atomic_init(&s->running, 1);
+	if (pthread_create(&s->thread, NULL, prefetch, s) != 0) {
+		atomic_store(&s->running, 0);
+		destroySampler(s);
+		return NULL;
+	}
+	return s;
+}
+
+/* -------------------------------------------------------------------------------------
+	destroySampler: the prefetch thread is stopped first, it sleeps only briefly
+------------------------------------------------------------------------------------- */
+void destroySampler(Sampler *s)
+{
+	int i;
+
+	if (s == NULL)
+		return;
+	if (atomic_load(&s->running)) {
+		atomic_store_explicit(&s->running, 0, memory_order_release);
+		pthread_join(s->thread, NULL);
+	}
+	for (i = 0; i < SAMPLE_STREAMS; i++) {
+		if (s->stream[i].fd >= 0)
+			close(s->stream[i].fd);
+		destroyRingBuffer(s->stream[i].ring);
+	}
+	for (i = 0; i < s->numZones; i++) {
+		free(s->zone[i].path);
+		free(s->zone[i].attack);
+	}
+	free(s->zone);
+	free(s);
+}
+
+/* -------------------------------------------------------------------------------------
+	samplerFind: the first zone that covers the note and velocity
+------------------------------------------------------------------------------------- */
+const Zone *samplerFind(const Sampler *s, int note, int vel)
+{
+	const Zone *z;
+	int i;
+
+	for (i = 0; i < s->numZones; i++) {
+		z = &s->zone[i];
+		if (note >= z->lokey && note <= z->hikey && vel >= z->lovel && vel <= z->hivel)
+			return z;
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	samplerStart: a sample longer than its attack takes a free stream. The root key is
+	tuned to 12-tone equal temperament at 440 Hz, so the step is the phase increment
+	times the samplerate of the file over the root frequency.
+------------------------------------------------------------------------------------- */
+void samplerStart(Sampler *s, int voice, const Zone *zone)
+{
+	SampleVoice *sv = &s->voice[voice];
+	Stream *st;
+	int i;
+
+	samplerStop(s, voice);
+	if (zone == NULL)
+		return;
+	sv->zone = zone;
+	sv->scale = zone->rate / (440 * pow(2, (zone->root - 69) / 12.0));
+	sv->pos = 0;
+	sv->base = 0;
+	sv->read = 0;
+	sv->len = 0;
+	sv->end = zone->attackLen;
+	if (zone->frames <= zone->attackLen)
+		return;
+	for (i = 0; i < SAMPLE_STREAMS; i++) {
+		st = &s->stream[i];
+		if (atomic_load_explicit(&st->state, memory_order_acquire) == STREAM_FREE) {
+			st->zone = zone;
+			atomic_store_explicit(&st->state, STREAM_START, memory_order_release);
+			sv->stream = st;
+			sv->end = zone->frames;
+			return;
+		}
+	}
+	atomic_fetch_add_explicit(&s->noStream, 1, memory_order_relaxed);
+}
+
+void samplerStop(Sampler *s, int voice)
+{
+	SampleVoice *sv = &s->voice[voice];
+
+	if (sv->stream != NULL)
+		atomic_store_explicit(&sv->stream->state, STREAM_STOP, memory_order_release);
+	sv->stream = NULL;
+	sv->zone = NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	fetch: the next count source frames of the voice are taken into dst, from the attack,
+	then from the ring of the stream, and silence after the end. Returns the frames
+	taken, fewer if the ring ran dry.
+------------------------------------------------------------------------------------- */
+static int fetch(SampleVoice *sv, float *dst, int count)
+{
+	Stream *st = sv->stream;
+	int got = 0, m;
+
+	while (got < count) {
+		if (sv->read < sv->zone->attackLen) {
+			m = sv->zone->attackLen - sv->read;
+			if (m > count - got)
+				m = count - got;
+			memcpy(dst + got, sv->zone->attack + sv->read, m * sizeof(float));
+		}
+		else if (sv->read >= sv->end) {
+			m = count - got;
+			memset(dst + got, 0, m * sizeof(float));
+		}
+		else if (atomic_load_explicit(&st->state, memory_order_acquire) == STREAM_PLAY) {
+			m = ringRead(st->ring, dst + got, count - got);
+			if (m == 0) {
+				/* the stream has ended early if the file could not be read further */
+				if (!atomic_load_explicit(&st->eof, memory_order_acquire))
+					break;
+				if ((m = ringRead(st->ring, dst + got, count - got)) == 0) {
+					sv->end = sv->read;
+					continue;
+				}
+			}
+		}
+		else
+			break;
+		got += m;
+		sv->read += m;
+	}
+	return got;
+}
+
+/* -------------------------------------------------------------------------------------
+	samplerRender: the frames behind the position are dropped from the window, and it is
+	filled up to the last frame the block will need. The step moves linearly over the
+	block like the phase increment of an oscillator.
+------------------------------------------------------------------------------------- */
+int samplerRender(Sampler *s, int voice, float *out, float inc0, float inc1, int n)
+{
+	SampleVoice *sv = &s->voice[voice];
+	float step, dstep, x0;
+	double pos;
+	int i, k, need;
+
+	if (sv->zone == NULL) {
+		dsp.clear(out, n);
+		return 1;
+	}
+	step = inc0 * sv->scale;
+	dstep = inc1 * sv->scale;
+	if (step > SAMPLE_MAX_STEP) step = SAMPLE_MAX_STEP;
+	if (dstep > SAMPLE_MAX_STEP) dstep = SAMPLE_MAX_STEP;
+	need = sv->pos + n * (step > dstep ? step : dstep) + 2;
+	dstep = (dstep - step) / n;
+
+	k = sv->pos;
+	if (k > sv->len)
+		k = sv->len;
+	if (k > 0) {
+		memmove(sv->win, sv->win + k, (sv->len - k) * sizeof(float));
+		sv->len -= k;
+		sv->base += k;
+		sv->pos -= k;
+		need -= k;
+	}
+	if (need > SAMPLE_WINDOW)
+		need = SAMPLE_WINDOW;
+	if (sv->len < need)
+		sv->len += fetch(sv, sv->win + sv->len, need - sv->len);
+	if (sv->len < need) {
+		/* the disk has not kept up, the voice waits for it */
+		atomic_fetch_add_explicit(&s->underruns, 1, memory_order_relaxed);
+		dsp.clear(out, n);
+		return 0;
+	}
+
+	pos = sv->pos;
+	for (i = 0; i < n; i++) {
+		k = pos;
+		x0 = sv->win[k];
+		out[i] = x0 + (float)(pos - k) * (sv->win[k + 1] - x0);
+		pos += step;
+		step += dstep;
+	}
+	sv->pos = pos;
+	return sv->base + pos >= sv->end;
+}
+
+/* -------------------------------------------------------------------------------------
+	samplerSync
+------------------------------------------------------------------------------------- */
+void samplerSync(Sampler *s)
+{
+	struct timespec wait = { 0, 100000 };
+	Stream *st;
+	int i, state;
+
+	for (i = 0; i < SAMPLE_STREAMS; i++) {
+		st = &s->stream[i];
+		while ((state = atomic_load_explicit(&st->state, memory_order_acquire)) == STREAM_START
+		       || (state == STREAM_PLAY && !atomic_load_explicit(&st->eof, memory_order_acquire)
+		           && ringSpace(st->ring) >= SAMPLE_CHUNK))
+			nanosleep(&wait, NULL);
+	}
+}
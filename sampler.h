@@ -0,0 +1,153 @@
+
+/*-----------------------------------------------------------------------------------
+    SAMPLER
+
+    Sampled instruments streamed from disk. An instrument is a set of zones, each a
+	WAV file played over a range of keys and velocities, and a part plays it instead
+	of its oscillator. The instrument is read from a small subset of the SFZ format.
+
+	-only the first SAMPLE_ATTACK frames of each sample are kept in memory, read when
+	 the instrument is loaded. The rest is read from the file while the note plays
+	-a prefetch thread reads ahead for every playing voice into the ring buffer of a
+	 stream. The audio thread only reads the rings and never waits for the disk. If
+	 a ring runs dry, the voice pauses for the block and an underrun is counted
+	-the memory used is the attacks plus SAMPLE_STREAMS rings, whatever the size of
+	 the files. The files are opened by the prefetch thread only while they play
+	-a stream is handed between the threads by its state: the audio thread takes a
+	 free stream and starts it, the prefetch thread resets and fills it, and the
+	 audio thread stops it, after which the prefetch thread frees it. The audio
+	 thread may stop a stream while it is still starting, so the prefetch thread
+	 moves it from START to PLAY with a compare and swap, and frees it if it finds
+	 STOP instead. No locks are needed
+	-samples are 16 or 24-bit integer or 32-bit float WAV, mono or stereo. Stereo
+	 is mixed to mono, as the voices are mono. The sample is played at the pitch
+	 of the note relative to its root key, with linear interpolation
+
+	SFZ subset: <group> and <region> headers (the opcodes of other headers are
+	taken as defaults like those of a group), and the opcodes sample, key, lokey,
+	hikey, lovel, hivel and pitch_keycenter. Keys are midi note numbers. Sample
+	paths are relative to the .sfz file, // starts a comment.
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ringbuf.h"
+#include "voice.h"
+#include "dsp.h"
+
+/* frames of each sample kept in memory, frames of read-ahead per stream (a power of
+   two) and frames read from a file at once */
+#define SAMPLE_ATTACK 16384
+#define SAMPLE_RING   16384
+#define SAMPLE_CHUNK  2048
+
+/* streams that can play at once. Some more than voices, as a stopped stream is freed
+   by the prefetch thread a little later */
+#define SAMPLE_STREAMS (MAX_VOICES + 32)
+
+/* fastest playback, source frames per output frame, and the window of source frames
+   a voice needs for one block at that speed */
+#define SAMPLE_MAX_STEP 8
+#define SAMPLE_WINDOW (DSP_BLOCK * SAMPLE_MAX_STEP + 4)
+
+/* how long the prefetch thread sleeps when no stream needs data (nanoseconds) */
+#define PREFETCH_IDLE_NS 2000000
+
+/* stream states */
+#define STREAM_FREE  0   /* owned by the audio thread */
+#define STREAM_START 1   /* the prefetch thread opens it, the audio thread may still stop it */
+#define STREAM_PLAY  2   /* the prefetch thread writes the ring, the audio thread reads it */
+#define STREAM_STOP  3   /* owned by the prefetch thread until it sets FREE */
+
+typedef struct
+{
+	char *path;
+	int   lokey, hikey, lovel, hivel;
+	int   root;              /* key that plays the sample at its own pitch */
+	unsigned int rate;       /* samplerate of the file */
+	int   channels, bits, isFloat;
+	long long offset;        /* of the sample data in the file, bytes */
+	long long frames;
+	float *attack;           /* the first frames, mono */
+	int   attackLen;
+} Zone;
+
+typedef struct
+{
+	atomic_int  state;
+	const Zone *zone;        /* set by the audio thread before START */
+	RingBuffer *ring;        /* mono frames from attackLen on */
+	int   fd;                /* the rest is used only by the prefetch thread */
+	long long next;          /* next frame to read from the file */
+	atomic_int eof;          /* everything there is has been written into the ring */
+} Stream;
+
+/* playing state of one voice, used only by the thread that renders the voice */
+typedef struct
+{
+	const Zone *zone;        /* NULL if the voice plays no sample */
+	Stream *stream;          /* NULL if the whole sample is in the attack */
+	long long end;           /* frames that play, the attack only if there is no stream */
+	float  scale;            /* source frames per output frame, per phase increment */
+	double pos;              /* position of the next output frame in the window */
+	long long base;          /* source frame at win[0] */
+	long long read;          /* next source frame to take into the window */
+	int    len;              /* frames in the window */
+	float  win[SAMPLE_WINDOW];
+} SampleVoice;
+
+typedef struct
+{
+	Zone *zone;
+	int   numZones;
+	int   failed;                   /* regions left out, their samples could not be read */
+	Stream stream[SAMPLE_STREAMS];
+	SampleVoice voice[MAX_VOICES];  /* indexed like the voices of the pool */
+	size_t memory;                  /* bytes of attacks and rings */
+	atomic_ulong underruns;         /* blocks a voice paused for lack of data */
+	atomic_ulong noStream;          /* notes cut at the end of the attack, no stream was free */
+	atomic_int running;
+	pthread_t thread;
+} Sampler;
+
+
+/*---------------------------------------------------------------------------
+	loadSampler reads an instrument from an .sfz file with the attacks of its
+	samples and starts the prefetch thread. Returns NULL if the file cannot be
+	read or none of its samples can be used.
+------------------------------------------------------------------------------*/
+Sampler *loadSampler(const char *path);
+
+void destroySampler(Sampler *s);
+
+/*---------------------------------------------------------------------------
+	samplerFind returns the zone for note and velocity, NULL if none
+------------------------------------------------------------------------------*/
+const Zone *samplerFind(const Sampler *s, int note, int vel);
+
+/*---------------------------------------------------------------------------
+	samplerStart starts playing zone on voice number voice, and samplerStop
+	stops it. Called on the audio thread, between blocks. samplerStart with a
+	NULL zone only stops.
+------------------------------------------------------------------------------*/
+void samplerStart(Sampler *s, int voice, const Zone *zone);
+void samplerStop(Sampler *s, int voice);
+
+/*---------------------------------------------------------------------------
+	samplerRender writes n <= DSP_BLOCK frames of the voice into out, while the
+	phase increment of the note (cycles per sample) moves from inc0 to inc1.
+	Returns 1 when the sample has ended.
+------------------------------------------------------------------------------*/
+int samplerRender(Sampler *s, int voice, float *out, float inc0, float inc1, int n);
+
+/*---------------------------------------------------------------------------
+	samplerSync waits until the prefetch thread has filled every playing stream.
+	For offline rendering, which runs faster than the disk may keep up with.
+------------------------------------------------------------------------------*/
+void samplerSync(Sampler *s);
+
+#endif
@@ -0,0 +1,233 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+static int shared; /* the statistics of this process are in the shared segment */
+
+static const char *xrunNames[NUM_XRUNS] = {
+	"input underflow", "input overflow", "output underflow", "output overflow", "priming"
+};
+
+
+/* -------------------------------------------------------------------------------------
+	get, add, setMax: the counters have a single writer, so a load and a store are
+	enough and no locked instructions are needed
+------------------------------------------------------------------------------------- */
+static inline unsigned long get(atomic_ulong *a)
+{
+	return atomic_load_explicit(a, memory_order_relaxed);
+}
+
+static inline void add(atomic_ulong *a, unsigned long n)
+{
+	atomic_store_explicit(a, get(a) + n, memory_order_relaxed);
+}
+
+static inline void setMax(atomic_ulong *a, unsigned long n)
+{
+	if (n > get(a))
+		atomic_store_explicit(a, n, memory_order_relaxed);
+}
+
+/* -------------------------------------------------------------------------------------
+	statsOpen
+------------------------------------------------------------------------------------- */
+Stats *statsOpen(unsigned int samplerate, unsigned int framecount)
+{
+	Stats *s = MAP_FAILED;
+	int fd;
+
+	fd = shm_open(STATS_NAME, O_CREAT | O_RDWR, 0644);
+	if (fd >= 0) {
+		if (ftruncate(fd, sizeof(Stats)) == 0)
+			s = mmap(NULL, sizeof(Stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+	}
+	if (s != MAP_FAILED)
+		shared = 1;
+	else {
+		shm_unlink(STATS_NAME);
+		s = malloc(sizeof(Stats));
+		if (s == NULL)
+			return NULL;
+		shared = 0;
+	}
+
+	/* a segment left by a synth that crashed is cleared, the magic is written last */
+	s->magic = 0;
+	atomic_thread_fence(memory_order_release);
+	memset((char*)s + sizeof(s->magic), 0, sizeof(Stats) - sizeof(s->magic));
+	s->version = STATS_VERSION;
+	s->samplerate = samplerate;
+	s->framecount = framecount;
+	s->pid = getpid();
+	atomic_thread_fence(memory_order_release);
+	s->magic = STATS_MAGIC;
+	return s;
+}
+
+/* -------------------------------------------------------------------------------------
+	statsClose
+------------------------------------------------------------------------------------- */
+void statsClose(Stats *s)
+{
+	if (s == NULL)
+		return;
+	if (shared) {
+		munmap(s, sizeof(Stats));
+		shm_unlink(STATS_NAME);
+	}
+	else
+		free(s);
+}
+
+/* -------------------------------------------------------------------------------------
+	statsAttach, statsDetach
+------------------------------------------------------------------------------------- */
+Stats *statsAttach()
+{
+	Stats *s;
+	int fd = shm_open(STATS_NAME, O_RDONLY, 0);
+
+	if (fd < 0)
+		return NULL;
+	s = mmap(NULL, sizeof(Stats), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED)
+		return NULL;
+	if (s->magic != STATS_MAGIC || s->version != STATS_VERSION) {
+		munmap(s, sizeof(Stats));
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	return s;
+}
+
+void statsDetach(Stats *s)
+{
+	if (s != NULL)
+		munmap(s, sizeof(Stats));
+}
+
+/* -------------------------------------------------------------------------------------
+	statsNow
+------------------------------------------------------------------------------------- */
+unsigned long statsNow()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (unsigned long)t.tv_sec * 1000000000UL + t.tv_nsec;
+}
+
+/* -------------------------------------------------------------------------------------
+	statsBlock, statsQuality
+------------------------------------------------------------------------------------- */
+double statsBlock(Stats *s, unsigned long start, unsigned long frames, int xrunBits,
+                  double latency, unsigned long events, unsigned long voices)
+{
+	unsigned long ns = statsNow() - start;
+	unsigned long deadline = frames * 1000000000UL / s->samplerate;
+	unsigned long b;
+	int i;
+
+	add(&s->blocks, 1);
+	add(&s->frames, frames);
+	atomic_store_explicit(&s->lastNs, ns, memory_order_relaxed);
+	setMax(&s->maxNs, ns);
+	add(&s->totalNs, ns);
+	atomic_store_explicit(&s->deadlineNs, deadline, memory_order_relaxed);
+	if (ns > deadline)
+		add(&s->overruns, 1);
+
+	b = (deadline > 0) ? ns * LOAD_STEPS / deadline : LOAD_BUCKETS;
+	add(&s->load[b < LOAD_BUCKETS ? b : LOAD_BUCKETS - 1], 1);
+
+	for (i = 0; i < NUM_XRUNS; i++) {
+		if (xrunBits & (1 << i))
+			add(&s->xruns[i], 1);
+	}
+	if (latency > 0)
+		atomic_store_explicit(&s->latencyUs, (unsigned long)(latency * 1e6), memory_order_relaxed);
+
+	/* the queue is drained every block, so the events of a block are its depth */
+	add(&s->events, events);
+	setMax(&s->queueHigh, events);
+	for (b = 0; events > 0 && b < EVENT_BUCKETS - 1; b++)
+		events >>= 1;
+	add(&s->eventHist[b], 1);
+
+	atomic_store_explicit(&s->voices, voices, memory_order_relaxed);
+	setMax(&s->voicesMax, voices);
+	b = voices / VOICE_STEP;
+	add(&s->voiceHist[b < VOICE_BUCKETS ? b : VOICE_BUCKETS - 1], 1);
+	return (deadline > 0) ? (double)ns / deadline : 0;
+}
+
+void statsQuality(Stats *s, int level)
+{
+	atomic_store_explicit(&s->quality, level, memory_order_relaxed);
+	add(&s->qualityChanges, 1);
+}
+
+/* -------------------------------------------------------------------------------------
+	statsMidi, statsPortOverflow
+------------------------------------------------------------------------------------- */
+void statsMidi(Stats *s, unsigned long count, unsigned long dropped)
+{
+	add(&s->midiEvents, count);
+	add(&s->midiDropped, dropped);
+}
+
+void statsPortOverflow(Stats *s)
+{
+	add(&s->portOverflows, 1);
+}
+
+/* -------------------------------------------------------------------------------------
+	printHist: one line of bucket counts
+------------------------------------------------------------------------------------- */
+static void printHist(FILE *f, const char *name, atomic_ulong *h, int n)
+{
+	int i;
+
+	fprintf(f, "%-16s", name);
+	for (i = 0; i < n; i++)
+		fprintf(f, " %lu", get(&h[i]));
+	fprintf(f, "\n");
+}
+
+/* -------------------------------------------------------------------------------------
+	statsPrint
+------------------------------------------------------------------------------------- */
+void statsPrint(Stats *s, FILE *f)
+{
+	unsigned long blocks = get(&s->blocks);
+	unsigned long deadline = get(&s->deadlineNs);
+	double mean = blocks ? (double)get(&s->totalNs) / blocks : 0;
+	int i;
+
+	fprintf(f, "blocks           %lu, %lu frames at %u Hz\n", blocks, get(&s->frames), s->samplerate);
+	fprintf(f, "callback         last %.1f us, mean %.1f us, max %.1f us, deadline %.1f us\n",
+	        get(&s->lastNs) / 1e3, mean / 1e3, get(&s->maxNs) / 1e3, deadline / 1e3);
+	if (deadline > 0)
+		fprintf(f, "load             mean %.1f %%, max %.1f %%, overruns %lu\n",
+		        100 * mean / deadline, 100.0 * get(&s->maxNs) / deadline, get(&s->overruns));
+	fprintf(f, "device           latency %lu us", get(&s->latencyUs));
+	for (i = 0; i < NUM_XRUNS; i++)
+		fprintf(f, ", %s %lu", xrunNames[i], get(&s->xruns[i]));
+	fprintf(f, "\n");
+	fprintf(f, "events           %lu, queue high-water %lu\n", get(&s->events), get(&s->queueHigh));
+	fprintf(f, "midi input       %lu events, %lu dropped, %lu port overflows\n",
+	        get(&s->midiEvents), get(&s->midiDropped), get(&s->portOverflows));
+	fprintf(f, "voices           %lu, max %lu\n", get(&s->voices), get(&s->voicesMax));
+	fprintf(f, "quality          level %lu, %lu changes\n", get(&s->quality), get(&s->qualityChanges));
+	printHist(f, "load /8", s->load, LOAD_BUCKETS);
+	printHist(f, "events log2", s->eventHist, EVENT_BUCKETS);
+	printHist(f, "voices /8", s->voiceHist, VOICE_BUCKETS);
+}
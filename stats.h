@@ -0,0 +1,130 @@
+
+/*-----------------------------------------------------------------------------------
+    STATS
+
+    Always-on instrumentation of the real-time path: callback duration against
+	the deadline of the block, the status flags reported by the audio device,
+	midi events per block, queue depth, dropped events and voice counts.
+
+	-the statistics live in a POSIX shared memory segment, so an external tool
+	 (esp1stat) can watch a running synth. If the segment cannot be created,
+	 they are kept in ordinary memory and are only printed by the synth itself
+	-every field has exactly one writing thread: the audio thread writes the
+	 block statistics and the midi thread the input counters. Updates are
+	 relaxed atomic loads and stores, no locks and no system calls
+	-a reader sees each counter consistently, but different counters may be
+	 from different blocks
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define STATS_NAME    "/esp1-stats"
+#define STATS_MAGIC   0x45535031   /* "ESP1" */
+#define STATS_VERSION 2
+
+/* histogram of callback load, bucket i is i/8 - (i+1)/8 of the deadline, the last
+   bucket takes everything above */
+#define LOAD_BUCKETS 16
+#define LOAD_STEPS   8
+
+/* histogram of events per block: 0, 1, 2-3, 4-7 ... 256 and more */
+#define EVENT_BUCKETS 10
+
+/* histogram of active voices, in buckets of 8 voices */
+#define VOICE_BUCKETS 9
+#define VOICE_STEP    8
+
+/* status flags of the audio device, as counted */
+#define XRUN_IN_UNDERFLOW  0
+#define XRUN_IN_OVERFLOW   1
+#define XRUN_OUT_UNDERFLOW 2
+#define XRUN_OUT_OVERFLOW  3
+#define XRUN_PRIMING       4
+#define NUM_XRUNS          5
+
+typedef struct
+{
+	/* constant after statsOpen */
+	unsigned int magic;
+	unsigned int version;
+	unsigned int samplerate;
+	unsigned int framecount;
+	int          pid;
+
+	/* audio thread */
+	atomic_ulong  blocks;             /* callbacks so far */
+	atomic_ulong  frames;
+	atomic_ulong  lastNs;             /* duration of the last callback */
+	atomic_ulong  maxNs;              /* longest callback */
+	atomic_ulong  totalNs;
+	atomic_ulong  deadlineNs;         /* length of the last block in real time */
+	atomic_ulong  overruns;           /* callbacks that took longer than their block */
+	atomic_ulong  xruns[NUM_XRUNS];   /* device status flags */
+	atomic_ulong  latencyUs;          /* from the callback to the dac, last block */
+	atomic_ulong  load[LOAD_BUCKETS];
+	atomic_ulong  events;             /* events dequeued */
+	atomic_ulong  eventHist[EVENT_BUCKETS];
+	atomic_ulong  queueHigh;          /* high-water mark of the event queue, which is
+	                                     drained every block */
+	atomic_ulong  voices;             /* active voices after the last block */
+	atomic_ulong  voicesMax;
+	atomic_ulong  voiceHist[VOICE_BUCKETS];
+	atomic_ulong  quality;            /* quality level chosen by the governor */
+	atomic_ulong  qualityChanges;     /* decisions of the governor */
+
+	/* midi thread */
+	atomic_ulong  midiEvents;         /* events read from the port */
+	atomic_ulong  midiDropped;        /* events lost because the queue was full */
+	atomic_ulong  portOverflows;      /* times the port reported lost data */
+} Stats;
+
+
+/*---------------------------------------------------------------------------
+	statsOpen creates the shared segment, or reserves ordinary memory if it
+	cannot. statsClose releases it and removes the segment.
+------------------------------------------------------------------------------*/
+Stats *statsOpen(unsigned int samplerate, unsigned int framecount);
+void statsClose(Stats *s);
+
+/*---------------------------------------------------------------------------
+	statsAttach maps the segment of a running synth for reading, returns
+	NULL if there is none. statsDetach unmaps it.
+------------------------------------------------------------------------------*/
+Stats *statsAttach();
+void statsDetach(Stats *s);
+
+/*---------------------------------------------------------------------------
+	statsNow: monotonic clock in nanoseconds. Served from user space on the
+	systems we run on, so it is safe to call on the audio thread.
+------------------------------------------------------------------------------*/
+unsigned long statsNow();
+
+/*---------------------------------------------------------------------------
+	statsBlock records one callback that started at start (statsNow), with
+	the device status bits (1 << XRUN_*), the output latency in seconds, the
+	events taken from the queue and the voices left active. Returns the
+	duration as a fraction of the deadline. Called by the audio thread only.
+	statsQuality records a decision of the governor.
+------------------------------------------------------------------------------*/
+double statsBlock(Stats *s, unsigned long start, unsigned long frames, int xrunBits,
+                double latency, unsigned long events, unsigned long voices);
+void statsQuality(Stats *s, int level);
+
+/*---------------------------------------------------------------------------
+	statsMidi records what the midi thread read: count events, of which
+	dropped did not fit into the queue. Called by the midi thread only.
+------------------------------------------------------------------------------*/
+void statsMidi(Stats *s, unsigned long count, unsigned long dropped);
+void statsPortOverflow(Stats *s);
+
+/*---------------------------------------------------------------------------
+	statsPrint writes a readable summary
+------------------------------------------------------------------------------*/
+void statsPrint(Stats *s, FILE *f);
+
+#endif
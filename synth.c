@@ -0,0 +1,995 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "synth.h"
+
+unsigned int samplerate; 
+unsigned int framecount;
+
+
+/*------------------------------------------------------------------------------------
+	updateBend: the bend ratio of a part is computed from its pitch wheel position and
+	bend range, and applied to the sounding voices of the part
+--------------------------------------------------------------------------------------*/
+static void updateBend(AudioData *ad, int chan)
+{
+	Part *part = &ad->part[chan];
+	VoicePool *pool = ad->voices;
+	float range = part->bendSemis + part->bendCents * 0.01f;
+	Voice *v;
+	int i;
+
+	part->bend = bendRatio(ad->tuning, (part->pwheel - PWHEEL_MID) * range * (1.0f / PWHEEL_MID));
+	for (i = 0; i < pool->numActive; i++) {
+		v = &pool->voice[pool->active[i]];
+		if (v->chan == chan)
+			v->inc = v->oinc * part->bend;
+	}
+}
+
+/*------------------------------------------------------------------------------------
+	handleRpn: controllers 101 and 100 select a registered parameter, and data entry
+	(controllers 6 and 38) sets it. Data entry goes to the controller destinations
+	only when no parameter is selected. Returns 1 if the controller was used here.
+--------------------------------------------------------------------------------------*/
+static int handleRpn(AudioData *ad, int chan, unsigned char num, unsigned char value)
+{
+	Part *part = &ad->part[chan];
+
+	switch (num) {
+		case RPN_MSB:
+			part->rpn = (part->rpn & 0x7F) | (value << 7);
+			return 1;
+		case RPN_LSB:
+			part->rpn = (part->rpn & 0x3F80) | value;
+			return 1;
+		case NRPN_MSB:   /* non-registered parameters are not supported */
+		case NRPN_LSB:
+			part->rpn = RPN_NULL;
+			return 1;
+		case DATA_ENTRY:
+		case DATA_ENTRY_LSB:
+			if (part->rpn == RPN_NULL)
+				return 0;
+			if (part->rpn == RPN_BEND_RANGE) {
+				if (num == DATA_ENTRY)
+					part->bendSemis = (value < BEND_MAX) ? value : BEND_MAX;
+				else
+					part->bendCents = (value < 100) ? value : 99;
+				updateBend(ad, chan);
+			}
+			return 1;
+	}
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	releaseVoice: all envelopes of the voice are put to release stage
+---------------------------------------------------------------------------------------- */
+static void releaseVoice(Voice *v, EnvParams *env)
+{
+	int i;
+
+	for (i = 0; i < NUM_ENVS; i++)
+		envRelease(&v->env[i], &env[i]);
+}
+
+/* -------------------------------------------------------------------------------------
+	setPan: equal power panning, scaled so that a part in the middle plays at full level
+	on both channels. The gains are read from a table made in initSynthData.
+---------------------------------------------------------------------------------------- */
+static float panTable[128];
+
+static void setPan(Part *part, int value)
+{
+	if (value < 0) value = 0;
+	if (value > 127) value = 127;
+	smoothSet(&part->left, panTable[127 - value]);
+	smoothSet(&part->right, panTable[value]);
+}
+
+/* -------------------------------------------------------------------------------------
+	applyPatch: the sound of the part is set from a patch. Runs on the audio thread on
+	program change, so it only copies and clamps values; the level, pan and pulse width
+	glide to their new values like controller changes do.
+---------------------------------------------------------------------------------------- */
+static void applyPatch(Part *part, const Patch *p)
+{
+	EnvParams *env;
+	Lfo *lfo;
+	const ModSlot *s;
+	int e, i;
+
+	if (p->waveform >= 0 && p->waveform <= NUM_WAVES)
+		part->waveform = p->waveform;
+	smoothSet(&part->gain, (p->gain >= 0 && p->gain <= 1) ? p->gain : 0.5f);
+	setPan(part, p->pan);
+	smoothSet(&part->pw, (p->pw >= 1 && p->pw <= 99) ? p->pw : 50);
+
+	for (e = 0; e < NUM_ENVS; e++) {
+		env = &part->env[e];
+		for (i = ATT; i <= REL; i++) {
+			if (p->env[e][i] >= 0 && p->env[e][i] <= env->max_val[i])
+				env->value[i] = p->env[e][i];
+		}
+		env->shape = (p->env[e][ENV_SHAPE] != 0) ? ENV_EXPONENTIAL : ENV_LINEAR;
+		envUpdate(env);
+	}
+
+	for (i = 0; i < NUM_LFOS; i++) {
+		lfo = &part->mod->lfo[i];
+		lfo->shape = (p->lfo[i].shape >= LFO_SINE && p->lfo[i].shape <= LFO_RANDOM) ? p->lfo[i].shape : LFO_SINE;
+		lfo->rate = (p->lfo[i].rate >= 0 && p->lfo[i].rate <= 100) ? p->lfo[i].rate : 5;
+	}
+	for (i = 0; i < MOD_SLOTS; i++) {
+		s = &p->slot[i];
+		if (s->src >= 0 && s->src < NUM_SRCS && s->via >= 0 && s->via < NUM_SRCS
+		    && s->dst >= 0 && s->dst < NUM_DSTS)
+			modSetSlot(part->mod, i, s->src, s->via, s->dst, s->amount);
+		else
+			modSetSlot(part->mod, i, SRC_NONE, SRC_NONE, DST_NONE, 0);
+	}
+
+	for (i = 0; i < 128; i++)
+		part->ctdest[i] = (p->ctdest[i] < NUM_CTDEST) ? p->ctdest[i] : 0;
+	for (i = 0; i < NUM_FX; i++)
+		smoothSet(&part->send[i], (p->send[i] >= 0 && p->send[i] <= 1) ? p->send[i] : 0);
+
+	part->filter = (p->filter == FILTER_LP) ? FILTER_LP : FILTER_OFF;
+	smoothSet(&part->cutoff, (p->cutoff >= 0 && p->cutoff <= 127) ? p->cutoff : 127);
+	part->resonance = (p->resonance >= 0 && p->resonance <= 1) ? p->resonance : 0;
+	part->envAmount = (p->envAmount >= -96 && p->envAmount <= 96) ? p->envAmount : 0;
+	part->keytrack = (p->keytrack >= 0 && p->keytrack <= 1) ? p->keytrack : 0;
+	part->sampled = (p->sampled != 0);
+}
+
+/* -------------------------------------------------------------------------------------
+	handleMidiEvent: midi event is interpreted and changes applied to the part of its
+	channel
+---------------------------------------------------------------------------------------- */
+void handleMidiEvent(PmEvent *ev, SynthData *syn)
+{
+	unsigned char status = Pm_MessageStatus(ev->message), /* status byte */
+				 	data1 = Pm_MessageData1(ev->message), /* first data byte */
+					data2 = Pm_MessageData2(ev->message); /* second data byte */
+
+	/* get the message type and channel from the status byte by bit-masking */
+	unsigned char msg = status & 0xF0;
+	unsigned char chan = status & 0x0F;
+	
+	AudioData *ad = syn->ad;
+	Part *part = &ad->part[chan];
+	EnvParams *env = &part->env[ENV_AMP];
+	const Patch *patch;
+	const Zone *zone = NULL;
+	Voice *v;
+	int i;
+
+	/* Some devices use note_on with velocity 0 to indicate note_off. If an event like this is
+		detected, the message is changed to note_off. */
+	if (msg == NOTE_ON && data2 == 0) msg = NOTE_OFF;
+
+	switch (msg) {
+		/* NOTE_ON: note is added to the notelist, and a voice is started for it. If the same note is
+		   still sounding on the same channel, its voice is re-triggered instead of taking a new one.
+		   the velocity of the note is calculated as well */
+		case NOTE_ON:
+			if (noteInc(ad->tuning, data1) == 0)
+				break;   /* the key is not mapped in the tuning */
+			if (ad->sampler != NULL && part->sampled && (zone = samplerFind(ad->sampler, data1, data2)) == NULL)
+				break;   /* the instrument has no sample for the key and velocity */
+			addNote(syn->md->notelist, chan, data1, data2);
+			syn->md->keysDown = noteCount(syn->md->notelist);
+			v = findVoice(ad->voices, chan, data1);
+			if (v == NULL) {
+				v = allocVoice(ad->voices);
+				filterReset(&v->filter);
+			}
+			v->note = data1;
+			v->chan = chan;
+			v->vel = data2;
+			v->sustained = 0;
+			v->oinc = noteInc(ad->tuning, data1);
+			v->inc = v->oinc * part->bend;
+			v->max = 0.2 + data2 * 0.00629921; /* FIXME: Here should be a better calculation */
+			for (i = 0; i < NUM_ENVS; i++)
+				envTrigger(&v->env[i], &part->env[i]);
+			/* the sample starts from the beginning, a stolen voice stops the sample it had */
+			if (ad->sampler != NULL)
+				samplerStart(ad->sampler, v - ad->voices->voice, zone);
+			break;
+
+		/* NOTE_OFF: note is removed from the notelist, and its voice is put to release stage,
+		   or marked sustained if the hold pedal is pressed */
+		case NOTE_OFF:
+			removeNote(syn->md->notelist, chan, data1);
+			syn->md->keysDown = noteCount(syn->md->notelist);
+			v = findVoice(ad->voices, chan, data1);
+			if (v != NULL) {
+				if (part->hold)
+					v->sustained = 1;
+				else
+					releaseVoice(v, part->env);
+			}
+			break;
+
+		case PITCH_WH:   /* pitch wheel: the voices of the part are bent. The first data byte is the low 7 bits */
+			part->pwheel = data1 | (data2 << 7);
+			updateBend(ad, chan);
+			break;
+
+		case CH_PRESS:   /* channel pressure: a modulation source, deepens the vibrato by default */
+			modSetSource(part->mod, SRC_PRESSURE, data1 * (1.0f / 127));
+			break;
+
+		case PROG_CHANGE: /* program change: the patch is taken from the bank selected before */
+			patch = bankPatch(ad->bank, part->bank * 128 + data1);
+			if (patch != NULL)
+				applyPatch(part, patch);
+			break;
+
+		case CONTROL: /* controllers are handled according to the ctdest array of the part */
+			if (handleRpn(ad, chan, data1, data2))
+				break;
+			if (data1 == BANK_MSB) {
+				part->bank = (part->bank & 0x7F) | (data2 << 7);
+				break;
+			}
+			if (data1 == BANK_LSB) {
+				part->bank = (part->bank & 0x3F80) | data2;
+				break;
+			}
+			if (data1 == ALL_NOTES_OFF) {
+				/* as if every key of the channel was released, the hold pedal still holds */
+				for (i = 0; i < ad->voices->numActive; i++) {
+					v = &ad->voices->voice[ad->voices->active[i]];
+					if (v->chan != chan)
+						continue;
+					removeNote(syn->md->notelist, chan, v->note);
+					if (part->hold)
+						v->sustained = 1;
+					else
+						releaseVoice(v, part->env);
+				}
+				syn->md->keysDown = noteCount(syn->md->notelist);
+				break;
+			}
+
+			/* these controllers are also modulation sources, whatever their destination is */
+			if (data1 == MOD_WHEEL)
+				modSetSource(part->mod, SRC_MODWHEEL, data2 * (1.0f / 127));
+			else if (data1 == BREATH)
+				modSetSource(part->mod, SRC_BREATH, data2 * (1.0f / 127));
+			else if (data1 == FOOT_PEDAL)
+				modSetSource(part->mod, SRC_FOOT, data2 * (1.0f / 127));
+
+			switch (part->ctdest[data1]) {
+				case VOLUME:
+					smoothSet(&part->gain, 0.00787 * data2);
+					break;	
+				case WAVEFORM:
+					part->waveform = 0.031 * data2 + 1;	
+					break;
+				case PULSEWIDTH:	            
+					smoothSet(&part->pw, 5 + (data2 * 0.354));
+					break;
+				case VIBRATO_DEPTH:   /* the amount of the first matrix slot, up to a semitone */
+					modSetSlot(part->mod, 0, SRC_LFO1, SRC_NONE, DST_PITCH, data2 * (1.0f / 127));
+					break;
+				case VIBRATO_RATE:    /* the rate of LFO 1, 0.1 - 12.8 Hz */
+					part->mod->lfo[0].rate = 0.1 + data2 * 0.1;
+					break;
+				case ENV_ATTACK:
+					env->value[ATT] = data2 * (env->max_val[ATT] / 127);
+					envUpdate(env);
+					break;
+				case ENV_DECAY:
+					env->value[DEC] = data2 * (env->max_val[DEC] / 127);
+					envUpdate(env);
+					break;
+				case ENV_SUSTAIN:
+					env->value[SUS] = data2 * 0.7874; /* why only this works? */
+					envUpdate(env);
+					break;
+				case ENV_RELEASE:
+					env->value[REL] = data2 * (env->max_val[REL] / 127);
+					envUpdate(env);
+					break;
+				case HOLD:
+					part->hold = !(part->hold);
+					/* when the pedal is released, the voices it was holding are released */
+					if (!part->hold) {
+						for (i = 0; i < ad->voices->numActive; i++) {
+							v = &ad->voices->voice[ad->voices->active[i]];
+							if (v->sustained && v->chan == chan) {
+								v->sustained = 0;
+								releaseVoice(v, part->env);
+							}
+						}
+					}
+					break;
+				case PAN:
+					setPan(part, data2);
+					break;
+				case DELAY_SEND:
+					smoothSet(&part->send[FX_DELAY], data2 * (1.0f / 127));
+					break;
+				case CHORUS_SEND:
+					smoothSet(&part->send[FX_CHORUS], data2 * (1.0f / 127));
+					break;
+				case REVERB_SEND:
+					smoothSet(&part->send[FX_REVERB], data2 * (1.0f / 127));
+					break;
+				case CUTOFF:
+					smoothSet(&part->cutoff, data2);
+					break;
+				case RESONANCE:
+					part->resonance = data2 * (1.0f / 127);
+					break;
+				default:
+					break;
+			}
+	}
+}
+
+
+/* ---------------------------------------------------------------------------------------------------
+	applyParams: the changes published from the console are applied before a block. The envelope
+	values are checked against their limits, as the store does not know them.
+------------------------------------------------------------------------------------------------------ */
+static void applyParams(SynthData *syn)
+{
+	ParamChange c[32];
+	EnvParams *env;
+	Part *part;
+	int n, i, e, k;
+
+	while ((n = paramTake(syn->params, c, 32)) > 0) {
+		for (i = 0; i < n; i++) {
+			part = &syn->ad->part[c[i].part];
+			switch (c[i].id) {
+				case PARAM_WAVEFORM:
+					if (c[i].value >= 0 && c[i].value <= NUM_WAVES)
+						part->waveform = c[i].value;
+					break;
+				case PARAM_GAIN:
+					smoothSet(&part->gain, c[i].value);
+					break;
+				case PARAM_PAN:
+					setPan(part, c[i].value);
+					break;
+				case PARAM_PW:
+					smoothSet(&part->pw, c[i].value);
+					break;
+				default:
+					e = (c[i].id - PARAM_ENV) / ENV_PARAMS;
+					k = (c[i].id - PARAM_ENV) % ENV_PARAMS;
+					env = &part->env[e];
+					if (k == ENV_SHAPE)
+						env->shape = (c[i].value != 0) ? ENV_EXPONENTIAL : ENV_LINEAR;
+					else if (c[i].value >= 0 && c[i].value <= env->max_val[k])
+						env->value[k] = c[i].value;
+					envUpdate(env);
+					break;
+			}
+		}
+	}
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	sampledVoice: tells if the voice was started with a sample
+------------------------------------------------------------------------------------------------------ */
+static inline int sampledVoice(AudioData *ad, Voice *v)
+{
+	return ad->sampler != NULL && ad->sampler->voice[v - ad->voices->voice].zone != NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	renderVoice: one voice is rendered for n frames. First its amplitude envelope is written into
+	amp, then the oscillator into osc, one modulation segment at a time. The phase increment moves
+	linearly between the control points, in fixed point, so it is converted only at the control
+	points. A voice that goes through the filter gets a lane: its filter envelope is rendered too,
+	and the cutoff is computed at the start of every FILTER_CHUNK frames and turned into the
+	coefficients of the lane. A voice that was started with a sample plays it instead of the
+	oscillator. Returns 1 when the amplitude envelope or the sample has finished.
+------------------------------------------------------------------------------------------------------ */
+static int renderVoice(AudioData *ad, Voice *v, Scratch *s, float *osc, float *amp, int lane, int n)
+{
+	Part *part = &ad->part[v->chan];
+	ModMatrix *mod = part->mod;
+	Wavetable *wave = ad->waves->wave[part->waveform];
+	ModSegment *seg;
+	float vsrc[NUM_SRCS - SRC_VOICE], a[NUM_DSTS], b[NUM_DSTS];
+	float inc0, inc1, pw, g0, g1, key = 0, cut, *coef;
+	unsigned int fixed0, fixed1;
+	int finished, k, j, dinc, oct, c = 0, p, sample = sampledVoice(ad, v);
+
+	finished = envRender(&v->env[ENV_AMP], &part->env[ENV_AMP], amp, n);
+	if (wave == NULL && !sample)
+		return finished;
+	if (lane >= 0) {
+		envRender(&v->env[ENV_FILTER], &part->env[ENV_FILTER], s->fenv, n);
+		key = part->keytrack * (v->note - 60);
+	}
+
+	vsrc[SRC_VELOCITY - SRC_VOICE] = v->vel * (1.0f / 127);
+	vsrc[SRC_KEY - SRC_VOICE] = (v->note - 60) * (1.0f / 64);
+
+	/* the end of a segment is the start of the next one */
+	modVoice(mod, &mod->seg[0], 0, vsrc, b);
+	inc1 = v->inc * bendRatio(ad->tuning, b[DST_PITCH]);
+	fixed1 = wtInc(inc1);
+	for (k = 0; k < mod->numSegs; k++) {
+		seg = &mod->seg[k];
+		memcpy(a, b, sizeof(a));
+		inc0 = inc1;
+		fixed0 = fixed1;
+		modVoice(mod, seg, 1, vsrc, b);
+		inc1 = v->inc * bendRatio(ad->tuning, b[DST_PITCH]);
+		fixed1 = wtInc(inc1);
+		dinc = ((long long)fixed1 - fixed0) / seg->len;
+		oct = wtOctave(inc0 > inc1 ? inc0 : inc1);
+
+		/* the table of the right octave is chosen once per segment, for the higher end.
+		   the pulse wave is made from the sawtooth tables. When the governor has lowered
+		   the quality, the simple waveforms are computed without tables */
+		pw = (part->pw.from + (part->pw.cur - part->pw.from) * seg->pos / n + a[DST_PW]) * 0.01f;
+		if (pw < 0.01f) pw = 0.01f;
+		if (pw > 0.99f) pw = 0.99f;
+		if (sample)
+			finished |= samplerRender(ad->sampler, v - ad->voices->voice, osc + seg->pos, inc0, inc1, seg->len);
+		else if (ad->quality >= QUALITY_NAIVE && part->waveform <= SAW)
+			v->phase = wtRenderNaive(osc + seg->pos, part->waveform, v->phase, fixed0, dinc, pw, seg->len);
+		else if (part->waveform == PUL)
+			v->phase = wtRenderPulse(osc + seg->pos, wave->table[oct], v->phase, fixed0, dinc, pw, seg->len);
+		else
+			v->phase = wtRender(osc + seg->pos, wave->table[oct], v->phase, fixed0, dinc, seg->len);
+
+		/* amplitude modulation */
+		if (a[DST_AMP] != 0 || b[DST_AMP] != 0) {
+			g0 = 1 + a[DST_AMP];
+			g1 = (1 + b[DST_AMP] - g0) / seg->len;
+			for (j = 0; j < seg->len; j++) {
+				amp[seg->pos + j] *= (g0 > 0) ? g0 : 0;
+				g0 += g1;
+			}
+		}
+
+		/* the filter chunks that start in this segment. The coefficients come from the table of
+		   filter.h, and are computed again only when the cutoff moves a step */
+		for (; lane >= 0 && c * FILTER_CHUNK < seg->pos + seg->len; c++) {
+			p = c * FILTER_CHUNK;
+			cut = part->cutoff.from + (part->cutoff.cur - part->cutoff.from) * p / n + key
+			    + part->envAmount * s->fenv[p]
+			    + a[DST_CUTOFF] + (b[DST_CUTOFF] - a[DST_CUTOFF]) * (p - seg->pos) / seg->len;
+			filterCoefs(&v->filter, cut, part->resonance);
+			coef = s->coef + c * FILTER_COEFS * FILTER_LANES + lane;
+			coef[0] = v->filter.a1;
+			coef[FILTER_LANES] = v->filter.a2;
+			coef[2 * FILTER_LANES] = v->filter.a3;
+		}
+	}
+	return finished;
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	mixVoice: the oscillator and the envelope of a voice are multiplied into left and right with
+	the gains of the part, which ramp over the block while the smoothed parameters move, and into
+	the effect sends
+------------------------------------------------------------------------------------------------------ */
+static void mixVoice(AudioData *ad, Voice *v, Scratch *s, float *osc, float *amp, int n)
+{
+	Part *part = &ad->part[v->chan];
+	float g0, g1;
+	int e;
+
+	if (part->smoothing) {
+		g0 = v->max * part->gain.from;
+		g1 = v->max * part->gain.cur;
+		dsp.mulAddRamp(s->left, osc, amp, g0 * part->left.from, g1 * part->left.cur, n);
+		dsp.mulAddRamp(s->right, osc, amp, g0 * part->right.from, g1 * part->right.cur, n);
+	}
+	else {
+		g0 = v->max * part->gain.cur;
+		dsp.mulAdd(s->left, osc, amp, g0 * part->left.cur, n);
+		dsp.mulAdd(s->right, osc, amp, g0 * part->right.cur, n);
+	}
+
+	/* the effect sends are mono, and taken after the volume of the part */
+	for (e = 0; e < NUM_FX; e++) {
+		if (!(ad->sends & (1 << e)) || (part->send[e].from == 0 && part->send[e].cur == 0))
+			continue;
+		if (part->smoothing)
+			dsp.mulAddRamp(s->send[e], osc, amp, v->max * part->gain.from * part->send[e].from,
+			               v->max * part->gain.cur * part->send[e].cur, n);
+		else
+			dsp.mulAdd(s->send[e], osc, amp, v->max * part->gain.cur * part->send[e].cur, n);
+	}
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	filterLanes: the oscillators of nl voices are filtered together, one voice in each lane of the
+	filter kernel, and then mixed. The unused lanes are filtered silence.
+------------------------------------------------------------------------------------------------------ */
+static void filterLanes(AudioData *ad, Scratch *s, Voice **lv, int nl, int n)
+{
+	float ic1[FILTER_LANES], ic2[FILTER_LANES];
+	int l, c;
+
+	for (l = 0; l < FILTER_LANES; l++) {
+		if (l < nl) {
+			ic1[l] = lv[l]->filter.ic1;
+			ic2[l] = lv[l]->filter.ic2;
+			continue;
+		}
+		ic1[l] = ic2[l] = 0;
+		dsp.clear(s->fosc[l], n);
+		for (c = 0; c * FILTER_CHUNK < n; c++) {
+			s->coef[c * FILTER_COEFS * FILTER_LANES + l] = 0;
+			s->coef[c * FILTER_COEFS * FILTER_LANES + FILTER_LANES + l] = 0;
+			s->coef[c * FILTER_COEFS * FILTER_LANES + 2 * FILTER_LANES + l] = 0;
+		}
+	}
+	dsp.svf(s->fosc, ic1, ic2, s->coef, n);
+	for (l = 0; l < nl; l++) {
+		lv[l]->filter.ic1 = ic1[l];
+		lv[l]->filter.ic2 = ic2[l];
+		mixVoice(ad, lv[l], s, s->fosc[l], s->famp[l], n);
+	}
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	renderGroup: the voices at positions first - first + count - 1 of the active list are rendered
+	and mixed, last first. The voices without a filter are mixed one at a time, the filtered ones
+	are collected into the lanes of the filter and mixed when the lanes are full, and at the end.
+	Sets finished[] of the voices whose envelopes have finished.
+------------------------------------------------------------------------------------------------------ */
+static void renderGroup(AudioData *ad, Scratch *s, int first, int count, int n)
+{
+	VoicePool *pool = ad->voices;
+	Voice *v, *lv[FILTER_LANES];
+	Part *part;
+	int i, nl = 0;
+
+	for (i = first + count - 1; i >= first; i--) {
+		v = &pool->voice[pool->active[i]];
+		part = &ad->part[v->chan];
+		if (ad->waves->wave[part->waveform] == NULL && !sampledVoice(ad, v))
+			ad->finished[i] = renderVoice(ad, v, s, s->osc, s->amp, -1, n);
+		else if (part->filter == FILTER_OFF) {
+			ad->finished[i] = renderVoice(ad, v, s, s->osc, s->amp, -1, n);
+			mixVoice(ad, v, s, s->osc, s->amp, n);
+		}
+		else {
+			ad->finished[i] = renderVoice(ad, v, s, s->fosc[nl], s->famp[nl], nl, n);
+			lv[nl++] = v;
+			if (nl == FILTER_LANES) {
+				filterLanes(ad, s, lv, nl, n);
+				nl = 0;
+			}
+		}
+	}
+	if (nl > 0)
+		filterLanes(ad, s, lv, nl, n);
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	renderItem: the work function of the worker pool, renders the group of groupLen voices number
+	item with the buffers of the thread. A worker clears its mix buffers when it gets the first
+	group of a block.
+------------------------------------------------------------------------------------------------------ */
+static void renderItem(void *ctx, int item, int thread)
+{
+	AudioData *ad = ctx;
+	Scratch *s = &ad->scratch[thread];
+	int e, first = item * ad->groupLen;
+
+	if (thread > 0 && s->job != ad->job) {
+		dsp.clear(s->left, ad->blockLen);
+		dsp.clear(s->right, ad->blockLen);
+		for (e = 0; e < NUM_FX; e++) {
+			if (ad->sends & (1 << e))
+				dsp.clear(s->send[e], ad->blockLen);
+		}
+		s->job = ad->job;
+	}
+	renderGroup(ad, s, first, (ad->voices->numActive - first < ad->groupLen)
+	            ? ad->voices->numActive - first : ad->groupLen, ad->blockLen);
+}
+
+/* ---------------------------------------------------------------------------------------------------
+	renderBlock: the audio of all active voices of all parts is calculated for n <= DSP_BLOCK frames
+	and written into out as interleaved stereo. The smoothed parameters of the parts move one block,
+	and the modulation segments of the parts that have voices are computed, they are shared by the
+	voices of the part. With enough voices the
+	workers render them too, in groups of up to FILTER_LANES voices so that the filtered voices of a
+	group can share the filter kernel, and when all are done their mix buffers are summed. Voices are freed
+	only here, after the workers are done. Last the effect buses are processed, the ones that get
+	sends in this block and the ones that still have a tail.
+------------------------------------------------------------------------------------------------------ */
+static void renderBlock(SynthData *data, float *out, int n)
+{
+	AudioData *ad = data->ad;
+	VoicePool *pool = ad->voices;
+	Scratch *s = &ad->scratch[0];
+	Part *part;
+	float coef = 1 - expf(-n / (SMOOTH_TIME * samplerate));
+	int i, t, e, inputs = 0;
+
+	for (i = 0; i < NUM_PARTS; i++) {
+		part = &ad->part[i];
+		part->numVoices = 0;
+		part->smoothing = smoothBlock(&part->gain, coef) | smoothBlock(&part->left, coef)
+		                | smoothBlock(&part->right, coef);
+		for (e = 0; e < NUM_FX; e++)
+			part->smoothing |= smoothBlock(&part->send[e], coef);
+		smoothBlock(&part->pw, coef);
+		smoothBlock(&part->cutoff, coef);
+	}
+	for (i = 0; i < pool->numActive; i++)
+		ad->part[pool->voice[pool->active[i]].chan].numVoices++;
+	for (i = 0; i < NUM_PARTS; i++) {
+		part = &ad->part[i];
+		if (part->numVoices == 0)
+			continue;
+		modBlock(part->mod, n);
+		for (e = 0; e < NUM_FX; e++) {
+			if (part->send[e].from != 0 || part->send[e].cur != 0)
+				inputs |= 1 << e;
+		}
+	}
+	ad->sends = inputs | fxActive(ad->fx);
+
+	dsp.clear(s->left, n);
+	dsp.clear(s->right, n);
+	for (e = 0; e < NUM_FX; e++) {
+		if (ad->sends & (1 << e))
+			dsp.clear(s->send[e], n);
+	}
+
+	if (ad->workers != NULL && ad->workers->numThreads > 0 && pool->numActive >= WORKER_MIN_VOICES) {
+		t = ad->workers->numThreads + 1;
+		ad->groupLen = (pool->numActive + t - 1) / t;
+		if (ad->groupLen > FILTER_LANES)
+			ad->groupLen = FILTER_LANES;
+		ad->blockLen = n;
+		ad->job++;
+		workRun(ad->workers, (pool->numActive + ad->groupLen - 1) / ad->groupLen);
+		for (t = 1; t <= ad->workers->numThreads; t++) {
+			if (ad->scratch[t].job == ad->job) {
+				dsp.addScaled(s->left, ad->scratch[t].left, 1, n);
+				dsp.addScaled(s->right, ad->scratch[t].right, 1, n);
+				for (e = 0; e < NUM_FX; e++) {
+					if (ad->sends & (1 << e))
+						dsp.addScaled(s->send[e], ad->scratch[t].send[e], 1, n);
+				}
+			}
+		}
+	}
+	else
+		renderGroup(ad, s, 0, pool->numActive, n);
+
+	/* the voices are freed backwards, as freeing moves the last active voice. a voice whose
+	   envelope has finished is returned to the pool */
+	for (i = pool->numActive - 1; i >= 0; i--) {
+		if (!ad->finished[i])
+			continue;
+		if (ad->sampler != NULL)
+			samplerStop(ad->sampler, pool->active[i]);
+		freeVoice(pool, i);
+	}
+
+	if (ad->sends)
+		fxProcess(ad->fx, s->send, ad->sends, inputs, s->left, s->right, n);
+
+	/* write audio data to output */
+	dsp.interleave(out, s->left, s->right, ad->gain * VOICE_GAIN, n);
+}
+
+
+/* ---------------------------------------------------------------------------------------------------
+	renderFrames: renders any number of frames, in pieces of at most DSP_BLOCK frames. Parameter
+	changes are applied first. Midi events are not handled here, see pa_callback.
+------------------------------------------------------------------------------------------------------ */
+void renderFrames(SynthData *data, float *out, unsigned long frames)
+{
+	unsigned long n;
+
+	applyParams(data);
+	while (frames > 0) {
+		n = (frames < DSP_BLOCK) ? frames : DSP_BLOCK;
+		renderBlock(data, out, n);
+		out += 2 * n;
+		frames -= n;
+	}
+}
+
+
+/* ---------------------------------------------------------------------------------------------------
+	renderEvents: the block is rendered in pieces between the events
+------------------------------------------------------------------------------------------------------ */
+void renderEvents(SynthData *data, float *out, unsigned long frames, PmEvent *events,
+                  const unsigned long *at, int nev)
+{
+	unsigned long pos = 0;
+	int i;
+
+	applyParams(data);
+	for (i = 0; i < nev; i++) {
+		if (at[i] > pos && at[i] <= frames) {
+			renderFrames(data, out + 2 * pos, at[i] - pos);
+			pos = at[i];
+		}
+		handleMidiEvent(&events[i], data);
+	}
+	renderFrames(data, out + 2 * pos, frames - pos);
+}
+
+
+/* ---------------------------------------------------------------------------------------------------
+	setQuality
+------------------------------------------------------------------------------------------------------ */
+void setQuality(SynthData *data, int level)
+{
+	AudioData *ad = data->ad;
+	VoicePool *pool = ad->voices;
+	int i, limit, n, freed[MAX_VOICES];
+
+	if (level < QUALITY_FULL) level = QUALITY_FULL;
+	if (level > QUALITY_SHED) level = QUALITY_SHED;
+
+	for (i = 0; i < NUM_PARTS; i++)
+		modSetCoarse(ad->part[i].mod, level >= QUALITY_CTRL);
+
+	if (level == QUALITY_SHED) {
+		limit = pool->numActive - pool->numActive / 4;
+		if (ad->quality == QUALITY_SHED && limit > pool->limit)
+			limit = pool->limit;
+		n = limitVoices(pool, limit > SHED_MIN_VOICES ? limit : SHED_MIN_VOICES, freed);
+	}
+	else
+		n = limitVoices(pool, pool->size, freed);
+
+	/* the streams of shed sampled voices are stopped, as when a voice ends in renderBlock */
+	for (i = 0; ad->sampler != NULL && i < n; i++)
+		samplerStop(ad->sampler, freed[i]);
+	ad->quality = level;
+}
+
+/* -----------------------------------------------------------------------
+	blockBuffer: the buffers of different threads start on their own cache lines
+---------------------------------------------------------------------------*/
+static float *blockBuffer()
+{
+	float *b;
+
+	if (posix_memalign((void**)&b, CACHE_LINE, DSP_BLOCK * sizeof(float)) != 0)
+		return NULL;
+	return b;
+}
+
+/* -----------------------------------------------------------------------
+	defaultPatch
+---------------------------------------------------------------------------*/
+void defaultPatch(Patch *p)
+{
+	int i;
+
+	memset(p, 0, sizeof(Patch));
+	strcpy(p->name, "Init");
+	p->waveform = 1;
+	p->gain = 0.5;
+	p->pan = 64;
+	p->pw = 50;
+
+	/* the pitch envelope is triggered with every note, but has no destination yet, so it is not
+	   rendered. The filter envelope is rendered for the parts that have the filter on */
+	p->env[ENV_AMP][ATT] = 3;
+	p->env[ENV_AMP][DEC] = 180;
+	p->env[ENV_AMP][SUS] = 60;
+	p->env[ENV_AMP][REL] = 800;
+	p->env[ENV_AMP][ENV_SHAPE] = ENV_LINEAR;
+	p->env[ENV_FILTER][ATT] = 10;
+	p->env[ENV_FILTER][DEC] = 400;
+	p->env[ENV_FILTER][SUS] = 30;
+	p->env[ENV_FILTER][REL] = 800;
+	p->env[ENV_FILTER][ENV_SHAPE] = ENV_EXPONENTIAL;
+	p->env[ENV_PITCH][DEC] = 50;
+	p->env[ENV_PITCH][ENV_SHAPE] = ENV_EXPONENTIAL;
+
+	/* LFO 1 gives a slight vibrato, which channel pressure deepens */
+	for (i = 0; i < NUM_LFOS; i++) {
+		p->lfo[i].shape = LFO_SINE;
+		p->lfo[i].rate = 5;
+	}
+	p->slot[0] = (ModSlot){ SRC_LFO1, SRC_NONE, DST_PITCH, 0.05 };
+	p->slot[1] = (ModSlot){ SRC_LFO1, SRC_PRESSURE, DST_PITCH, 0.5 };
+
+	/* a loaded instrument replaces the oscillator */
+	p->sampled = 1;
+
+	/* assign controllers to default destinations */
+	p->ctdest[MIDI_VOL] = VOLUME;
+	p->ctdest[MIDI_PAN] = PAN;
+	p->ctdest[DATA_ENTRY] = WAVEFORM;
+	p->ctdest[MOD_WHEEL] = PULSEWIDTH;
+	p->ctdest[HOLD_PEDAL] = HOLD;
+	
+	/* NOTE: Kurzweil k2600 uses controller nums 22-28 for 
+		its sliders. May not be used by other manufacturers */
+	p->ctdest[22] = ENV_ATTACK;
+	p->ctdest[23] = ENV_DECAY;
+	p->ctdest[24] = ENV_SUSTAIN;
+	p->ctdest[25] = ENV_RELEASE;
+
+	/* the effect send controllers of general midi, and 94 for the delay */
+	p->ctdest[MIDI_REVERB] = REVERB_SEND;
+	p->ctdest[MIDI_CHORUS] = CHORUS_SEND;
+	p->ctdest[MIDI_DELAY] = DELAY_SEND;
+
+	/* the filter is off, patches turn it on. The sound controllers of general midi move it */
+	p->filter = FILTER_OFF;
+	p->cutoff = 100;
+	p->resonance = 0.2;
+	p->envAmount = 24;
+	p->keytrack = 0.5;
+	p->ctdest[MIDI_CUTOFF] = CUTOFF;
+	p->ctdest[MIDI_RESONANCE] = RESONANCE;
+}
+
+/* -----------------------------------------------------------------------
+	initPart: the part starts with the default patch, without gliding to it
+---------------------------------------------------------------------------*/
+static void initPart(Part *part)
+{
+	Patch patch;
+	int i;
+
+	part->mod = createModMatrix(samplerate);
+	for (i = 0; i < NUM_ENVS; i++)
+		envInit(&part->env[i], 0, 0, 0, 0, samplerate);
+	defaultPatch(&patch);
+	applyPatch(part, &patch);
+	smoothReset(&part->gain, part->gain.target);
+	smoothReset(&part->pw, part->pw.target);
+	smoothReset(&part->left, part->left.target);
+	smoothReset(&part->right, part->right.target);
+	for (i = 0; i < NUM_FX; i++)
+		smoothReset(&part->send[i], part->send[i].target);
+	smoothReset(&part->cutoff, part->cutoff.target);
+
+	part->pwheel = PWHEEL_MID;
+	part->rpn = RPN_NULL;
+	part->bank = 0;
+	part->bendSemis = PWHEEL_RANGE;
+	part->bendCents = 0;
+	part->bend = 1;
+	part->hold = 0;
+	part->numVoices = 0;
+}
+
+/* -----------------------------------------------------------------------
+	storePart: the initial parameters of a part are copied into the store
+---------------------------------------------------------------------------*/
+static void storePart(ParamStore *ps, int p, Part *part)
+{
+	int e, i;
+
+	paramInit(ps, p, PARAM_WAVEFORM, part->waveform);
+	paramInit(ps, p, PARAM_GAIN, part->gain.target);
+	paramInit(ps, p, PARAM_PAN, 64);
+	paramInit(ps, p, PARAM_PW, part->pw.target);
+	for (e = 0; e < NUM_ENVS; e++) {
+		for (i = ATT; i <= REL; i++)
+			paramInit(ps, p, ENV_PARAM(e, i), part->env[e].value[i]);
+		paramInit(ps, p, ENV_PARAM(e, ENV_SHAPE), part->env[e].shape);
+	}
+}
+
+/* -----------------------------------------------------------------------
+	initSynthData: reservation of memory and initialization of data
+---------------------------------------------------------------------------*/
+SynthData* initSynthData()
+{
+    SynthData *syn = malloc(sizeof(SynthData));
+	int i, e;
+	
+	syn->ad = malloc(sizeof(AudioData));
+	syn->ad->gain = 1;
+	syn->ad->quality = QUALITY_FULL;
+
+	for (i = 0; i < 128; i++)
+		panTable[i] = M_SQRT2 * sin(M_PI_2 * i / 127);
+	syn->params = createParamStore();
+	for (i = 0; i < NUM_PARTS; i++) {
+		initPart(&syn->ad->part[i]);
+		storePart(syn->params, i, &syn->ad->part[i]);
+	}
+
+	/* 12-tone equal temperament until a scala tuning is loaded */
+	syn->ad->tuning = createTuning(samplerate);
+
+	/* all voices are reserved here, none are allocated while the audio is running */
+	syn->ad->voices = createVoicePool(NUM_VOICES);
+
+	/* the oscillator tables are built once here */
+	syn->ad->waves = createWavetables();
+	syn->ad->bank = NULL;
+	syn->ad->sampler = NULL;
+
+	/* the warping table of the filter for this samplerate */
+	filterInit(samplerate);
+
+	/* the best render kernels for this processor, ESP1_SIMD=scalar|sse|avx overrides */
+	dspInit(getenv("ESP1_SIMD"));
+	for (i = 0; i <= MAX_WORKERS; i++) {
+		syn->ad->scratch[i].left = blockBuffer();
+		syn->ad->scratch[i].right = blockBuffer();
+		syn->ad->scratch[i].osc = blockBuffer();
+		syn->ad->scratch[i].amp = blockBuffer();
+		for (e = 0; e < NUM_FX; e++)
+			syn->ad->scratch[i].send[e] = blockBuffer();
+		for (e = 0; e < FILTER_LANES; e++) {
+			syn->ad->scratch[i].fosc[e] = blockBuffer();
+			syn->ad->scratch[i].famp[e] = blockBuffer();
+		}
+		syn->ad->scratch[i].fenv = blockBuffer();
+		syn->ad->scratch[i].coef = blockBuffer();  /* DSP_BLOCK / FILTER_CHUNK chunks of 24 */
+		syn->ad->scratch[i].job = 0;
+	}
+	syn->ad->job = 0;
+	syn->ad->blockLen = 0;
+	syn->ad->groupLen = 1;
+
+	/* all effect delay lines are reserved here */
+	syn->ad->fx = createFxBus(samplerate);
+	syn->ad->sends = 0;
+
+	syn->md = malloc(sizeof(MidiData));
+	syn->md->keysDown = 0;
+	syn->md->notelist = createNotelist();
+	syn->md->event_queue = createRingBuffer(EVENT_QUEUE_SIZE, sizeof(PmEvent));
+
+	/* one worker for each core but one, ESP1_THREADS overrides */
+	syn->ad->workers = createWorkerPool(-1, renderItem, syn->ad);
+	
+	return syn;
+}
+
+/* ------------------------------------------------------------------------
+	freeSynthData
+----------------------------------------------------------------------------*/
+void freeSynthData(SynthData *syn)
+{
+	int i, e;
+
+	destroyWorkerPool(syn->ad->workers);
+	free(syn->md->notelist); 
+	destroyRingBuffer(syn->md->event_queue);  
+	free(syn->md);
+	free(syn->ad->voices);
+	destroyWavetables(syn->ad->waves);
+	destroyFxBus(syn->ad->fx);
+	destroyTuning(syn->ad->tuning);
+	for (i = 0; i < NUM_PARTS; i++)
+		destroyModMatrix(syn->ad->part[i].mod);
+	for (i = 0; i <= MAX_WORKERS; i++) {
+		free(syn->ad->scratch[i].left);
+		free(syn->ad->scratch[i].right);
+		free(syn->ad->scratch[i].osc);
+		free(syn->ad->scratch[i].amp);
+		for (e = 0; e < NUM_FX; e++)
+			free(syn->ad->scratch[i].send[e]);
+		for (e = 0; e < FILTER_LANES; e++) {
+			free(syn->ad->scratch[i].fosc[e]);
+			free(syn->ad->scratch[i].famp[e]);
+		}
+		free(syn->ad->scratch[i].fenv);
+		free(syn->ad->scratch[i].coef);
+	}
+	free(syn->ad);
+	destroyParamStore(syn->params);
+	free(syn);	
+}
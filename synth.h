@@ -0,0 +1,248 @@
+
+/*-----------------------------------------------------------------------------------
+    SYNTH
+
+    The synthesis engine of ESP-1: the synth data structures, midi event handling
+	and rendering. The engine does not depend on any audio or midi device, it is
+	driven by the PortAudio callback in esp1.c and by the offline renderer.
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdatomic.h>
+#include <portmidi.h>
+#include "notelist.h"
+#include "envelope.h"
+#include "voice.h"
+#include "ringbuf.h"
+#include "wavetable.h"
+#include "tuning.h"
+#include "modulation.h"
+#include "workers.h"
+#include "params.h"
+#include "patch.h"
+#include "fx.h"
+#include "sampler.h"
+#include "dsp.h"
+
+/* midi message types */
+#define NOTE_ON  0x90 
+#define NOTE_OFF 0x80 
+#define CONTROL  0xB0
+#define PROG_CHANGE 0xC0
+#define CH_PRESS 0xD0
+#define PITCH_WH 0xE0
+
+/* midi controller numbers */
+#define BANK_MSB   0
+#define MOD_WHEEL  1
+#define BREATH     2
+#define FOOT_PEDAL 3
+#define DATA_ENTRY 6
+#define MIDI_VOL   7
+#define MIDI_PAN   10
+#define SLIDER_1   16
+#define SLIDER_2   17
+#define SLIDER_3   18
+#define SLIDER_4   19
+#define BANK_LSB   32
+#define DATA_ENTRY_LSB 38
+#define HOLD_PEDAL 64
+#define MIDI_RESONANCE 71
+#define MIDI_CUTOFF 74
+#define MIDI_REVERB 91
+#define MIDI_CHORUS 93
+#define MIDI_DELAY  94
+#define NRPN_LSB   98
+#define NRPN_MSB   99
+#define RPN_LSB    100
+#define RPN_MSB    101
+#define ALL_NOTES_OFF 123
+
+/* registered parameter numbers */
+#define RPN_BEND_RANGE 0
+#define RPN_NULL       0x3FFF
+
+/* the pitch wheel is a 14-bit value, the default range is +-2 semitones */
+#define PWHEEL_MID 8192
+#define PWHEEL_RANGE 2
+
+/* size of the queue for midi events between the threads */
+#define EVENT_QUEUE_SIZE 512
+
+/* fewer voices than this are rendered on the audio thread alone */
+#define WORKER_MIN_VOICES 8
+
+/* quality levels, chosen by the governor when the audio thread runs out of time */
+#define QUALITY_FULL  0   /* everything as set */
+#define QUALITY_CTRL  1   /* modulation with one control point per block */
+#define QUALITY_NAIVE 2   /* pulse, triangle and sawtooth without band limiting */
+#define QUALITY_SHED  3   /* the quietest voices are dropped, a quarter at a time */
+#define NUM_QUALITY   4
+
+/* shedding never goes below this many voices */
+#define SHED_MIN_VOICES 8
+
+/* output scaling, leaves headroom for summing several voices */
+#define VOICE_GAIN 0.25
+       
+/* controller destinations */
+#define VOLUME        1
+#define WAVEFORM      2
+#define FREQUENCY     3
+#define PULSEWIDTH    4
+#define VIBRATO_DEPTH 5
+#define VIBRATO_RATE  6
+#define ENV_ATTACK    7
+#define ENV_DECAY     8
+#define ENV_SUSTAIN   9
+#define ENV_RELEASE   10
+#define HOLD          11
+#define PAN           12
+#define DELAY_SEND    13
+#define CHORUS_SEND   14
+#define REVERB_SEND   15
+#define CUTOFF        16
+#define RESONANCE     17
+#define NUM_CTDEST    18
+
+
+/* mididata structure */
+typedef struct
+{
+	RingBuffer *event_queue; /* lock-free queue for transferring midi events between threads */
+	Notelist *notelist;   /* the notes that are on, in order of arrival */
+	int keysDown;         /* tells how many keys are pressed down. Needed for example the implementation of hold pedal. */
+} MidiData;
+
+
+/* part: the sound and the controller state of one midi channel */
+typedef struct
+{
+	int    waveform;  /* the type of waveform  */
+	Smooth gain;
+	Smooth pw;        /* pulsewidth            */
+	Smooth left;      /* pan gains             */
+	Smooth right;
+	Smooth send[NUM_FX]; /* effect sends */
+	int    filter;    /* FILTER_OFF or FILTER_LP */
+	Smooth cutoff;    /* midi note scale */
+	float  resonance;
+	float  envAmount; /* semitones at the top of the filter envelope */
+	float  keytrack;
+	int    sampled;   /* notes play the sampled instrument, if there is one */
+
+	EnvParams  env[NUM_ENVS]; /* amplitude, filter and pitch envelope parameters, the states are kept in each voice */
+	ModMatrix *mod;   /* lfos and the modulation routing */
+	int ctdest[128];  /* indicates destinations for midi controllers */
+
+	int pwheel;       /* pitch wheel state has to be stored, because the state must be retained after other events. */
+	int rpn;          /* selected registered parameter, RPN_NULL if none */
+	int bank;         /* bank select, 14 bits, for the next program change */
+	int bendSemis;    /* pitch bend range set with RPN 0, semitones and cents */
+	int bendCents;
+	float bend;       /* frequency ratio of the current pitch wheel position */
+	int hold;         /* the state of hold pedal */
+	int numVoices;    /* voices sounding in the current block */
+	int smoothing;    /* gain, pan or a send is moving in the current block */
+} Part;
+
+
+/* block buffers of one rendering thread */
+typedef struct
+{
+	float *left;        /* stereo mix */
+	float *right;
+	float *osc;
+	float *amp;
+	float *send[NUM_FX]; /* effect buses */
+	float *fosc[FILTER_LANES]; /* oscillators and envelopes of the voices filtered together */
+	float *famp[FILTER_LANES];
+	float *fenv;        /* filter envelope */
+	float *coef;        /* filter coefficients of the lanes, see dsp.h */
+	unsigned int job;   /* the job the mix buffers were last cleared for */
+} Scratch;
+
+
+/* audio data */
+typedef struct
+{
+	Part   part[NUM_PARTS]; /* indexed by midi channel */
+	float  gain;      /* master gain */
+	int    quality;   /* QUALITY_* */
+
+	VoicePool  *voices; /* the voices of all parts, each with own phase, frequency and envelope state */
+	WavetableSet *waves; /* band-limited tables for all waveforms */
+	const PatchBank *bank; /* patches for program change, NULL if none. Set before the audio starts */
+	Sampler *sampler; /* sampled instrument, NULL if none. Set before the audio starts */
+	Tuning *tuning;   /* phase increments of the notes and the bend ratio table */
+
+	Scratch scratch[MAX_WORKERS + 1]; /* block buffers, [0] for the audio thread, its mix is the output */
+	FxBus *fx;           /* master effects */
+	int    sends;        /* effect buses in use in the current block, 1 << FX_* */
+	WorkerPool *workers; /* threads that render voices in parallel with the audio thread */
+	unsigned int job;    /* number of the current parallel block */
+	int blockLen;        /* frames in the current parallel block */
+	int groupLen;        /* voices in one work item */
+	unsigned char finished[MAX_VOICES]; /* voices finished in the parallel block, by active index */
+
+} AudioData;
+
+
+/* synthdata, a combination of audio and midi data */
+typedef struct
+{
+	AudioData *ad;
+	MidiData *md;	
+	ParamStore *params; /* parameters set from the console, published to the audio thread */
+} SynthData;
+
+
+/* globals ---------------------------------------------------------------------------- */
+extern unsigned int samplerate; 
+extern unsigned int framecount;  /* how many frames are written at once in the audio callback */
+
+
+/* -------------------------------------------------------------------------------------
+	handleMidiEvent: midi event is interpreted and changes applied to the audio data
+---------------------------------------------------------------------------------------- */
+void handleMidiEvent(PmEvent *ev, SynthData *syn);
+
+/* ---------------------------------------------------------------------------------------------------
+	renderFrames: renders frames of interleaved stereo audio into out, no events are handled.
+	The parameter changes published through syn->params are applied before rendering.
+------------------------------------------------------------------------------------------------------ */
+void renderFrames(SynthData *data, float *out, unsigned long frames);
+
+/* ---------------------------------------------------------------------------------------------------
+	renderEvents: renders frames of interleaved stereo audio into out, and handles the nev events
+	so that events[i] takes effect on frame at[i] of the block. at[] must not decrease.
+------------------------------------------------------------------------------------------------------ */
+void renderEvents(SynthData *data, float *out, unsigned long frames, PmEvent *events,
+                  const unsigned long *at, int nev);
+
+/* ---------------------------------------------------------------------------------------------------
+	setQuality: sets the quality level, called between blocks by the thread that renders. Setting
+	QUALITY_SHED again drops another quarter of the voices. Going below it lifts the voice limit.
+------------------------------------------------------------------------------------------------------ */
+void setQuality(SynthData *data, int level);
+
+/* -----------------------------------------------------------------------
+	defaultPatch: the sound every part starts with
+---------------------------------------------------------------------------*/
+void defaultPatch(Patch *p);
+
+/* -----------------------------------------------------------------------
+	initSynthData: reservation of memory and initialization of data.
+	samplerate must be set before calling.
+---------------------------------------------------------------------------*/
+SynthData* initSynthData();
+
+/* -----------------------------------------------------------------------
+	freeSynthData: releases everything reserved by initSynthData
+---------------------------------------------------------------------------*/
+void freeSynthData(SynthData *syn);
+
+#endif
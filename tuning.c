@@ -0,0 +1,237 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tuning.h"
+
+/* the largest scale and keyboard mapping accepted */
+#define MAX_DEGREES 1024
+
+/* keyboard mapping, in the order of the .kbm file */
+typedef struct
+{
+	int size;               /* 0 maps the keys linearly to scale degrees */
+	int first, last;        /* range of keys that are mapped */
+	int middle;             /* key where scale degree 0 is */
+	int refNote;
+	double refFreq;
+	int octaveDegree;       /* degree of the formal octave, 0 = the period of the scale */
+	int map[MAX_DEGREES];   /* scale degree of each key of the pattern, -1 = unmapped */
+} KeyMap;
+
+
+/* -------------------------------------------------------------------------------------
+	createTuning
+------------------------------------------------------------------------------------- */
+Tuning *createTuning(float samplerate)
+{
+	Tuning *t = malloc(sizeof(Tuning));
+	int i;
+
+	t->samplerate = samplerate;
+	for (i = 0; i < BEND_SIZE; i++)
+		t->bend[i] = pow(2.0, ((double)i / BEND_RES - BEND_MAX) / 12.0);
+	setEqualTuning(t, TUNING_REF_NOTE, TUNING_REF_FREQ);
+	return t;
+}
+
+void destroyTuning(Tuning *t)
+{
+	free(t);
+}
+
+/* -------------------------------------------------------------------------------------
+	setEqualTuning
+------------------------------------------------------------------------------------- */
+void setEqualTuning(Tuning *t, int refNote, double refFreq)
+{
+	int i;
+
+	for (i = 0; i < TUNING_NOTES; i++)
+		t->inc[i] = refFreq * pow(2.0, (i - refNote) / 12.0) / t->samplerate;
+}
+
+/* -------------------------------------------------------------------------------------
+	nextLine: reads the next line that is not a comment. Scala comments start with '!'.
+------------------------------------------------------------------------------------- */
+static char *nextLine(FILE *f, char *line, int size)
+{
+	while (fgets(line, size, f) != NULL) {
+		if (line[0] != '!')
+			return line;
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	parsePitch: a pitch with a period is in cents, otherwise it is a ratio a/b or a
+	whole number. Returns 0 on success.
+------------------------------------------------------------------------------------- */
+static int parsePitch(const char *s, double *cents)
+{
+	char word[64];
+	long a, b;
+
+	if (sscanf(s, " %63s", word) != 1)
+		return 1;
+	if (strchr(word, '.') != NULL)
+		return sscanf(word, "%lf", cents) != 1;
+	if (sscanf(word, "%ld/%ld", &a, &b) == 2) {
+		if (a <= 0 || b <= 0)
+			return 1;
+	}
+	else if (sscanf(word, "%ld", &a) == 1 && a > 0)
+		b = 1;
+	else
+		return 1;
+	*cents = 1200.0 * log2((double)a / b);
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	readScale: degree[0] is 0 cents, degree[n] is the period. Returns the number of
+	notes in the scale, 0 on error.
+------------------------------------------------------------------------------------- */
+static int readScale(const char *filename, double *degree)
+{
+	FILE *f = fopen(filename, "r");
+	char line[256];
+	int n, i;
+
+	if (f == NULL)
+		return 0;
+
+	/* the first line is the description, then the number of notes */
+	if (nextLine(f, line, sizeof(line)) == NULL || nextLine(f, line, sizeof(line)) == NULL
+	    || sscanf(line, "%d", &n) != 1 || n < 1 || n >= MAX_DEGREES) {
+		fclose(f);
+		return 0;
+	}
+	degree[0] = 0;
+	for (i = 1; i <= n; i++) {
+		if (nextLine(f, line, sizeof(line)) == NULL || parsePitch(line, &degree[i])) {
+			fclose(f);
+			return 0;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------
+	readKeyMap: returns 0 on success
+------------------------------------------------------------------------------------- */
+static int readKeyMap(const char *filename, KeyMap *km)
+{
+	FILE *f = fopen(filename, "r");
+	char line[256], word[64];
+	int *field[] = { &km->size, &km->first, &km->last, &km->middle, &km->refNote };
+	int i;
+
+	if (f == NULL)
+		return 1;
+	for (i = 0; i < 5; i++) {
+		if (nextLine(f, line, sizeof(line)) == NULL || sscanf(line, "%d", field[i]) != 1)
+			goto fail;
+	}
+	if (nextLine(f, line, sizeof(line)) == NULL || sscanf(line, "%lf", &km->refFreq) != 1
+	    || nextLine(f, line, sizeof(line)) == NULL || sscanf(line, "%d", &km->octaveDegree) != 1)
+		goto fail;
+	if (km->size < 0 || km->size >= MAX_DEGREES || km->refFreq <= 0)
+		goto fail;
+
+	/* an unmapped key is marked with x */
+	for (i = 0; i < km->size; i++) {
+		if (nextLine(f, line, sizeof(line)) == NULL || sscanf(line, " %63s", word) != 1)
+			goto fail;
+		if (word[0] == 'x' || word[0] == 'X')
+			km->map[i] = -1;
+		else if (sscanf(word, "%d", &km->map[i]) != 1 || km->map[i] < 0)
+			goto fail;
+	}
+	fclose(f);
+	return 0;
+
+fail:
+	fclose(f);
+	return 1;
+}
+
+/* -------------------------------------------------------------------------------------
+	degreeCents: the pitch of any scale degree, also above the period
+------------------------------------------------------------------------------------- */
+static double degreeCents(const double *degree, int n, int d)
+{
+	int oct = (d >= 0) ? d / n : -((-d + n - 1) / n);
+	return oct * degree[n] + degree[d - oct * n];
+}
+
+/* -------------------------------------------------------------------------------------
+	keyCents: the pitch of a key relative to the middle key. Returns 0 for an
+	unmapped key.
+------------------------------------------------------------------------------------- */
+static int keyCents(const KeyMap *km, const double *degree, int n, int key, double *cents)
+{
+	int i, oct, d;
+	double octave;
+
+	if (key < km->first || key > km->last)
+		return 0;
+	i = key - km->middle;
+	if (km->size == 0) {
+		*cents = degreeCents(degree, n, i);
+		return 1;
+	}
+	oct = (i >= 0) ? i / km->size : -((-i + km->size - 1) / km->size);
+	d = km->map[i - oct * km->size];
+	if (d < 0)
+		return 0;
+	octave = (km->octaveDegree > 0) ? degreeCents(degree, n, km->octaveDegree) : degree[n];
+	*cents = oct * octave + degreeCents(degree, n, d);
+	return 1;
+}
+
+/* -------------------------------------------------------------------------------------
+	loadScala: the pitches are computed in cents relative to the middle key, and
+	scaled so that the reference key is at the reference frequency
+------------------------------------------------------------------------------------- */
+int loadScala(Tuning *t, const char *scl, const char *kbm)
+{
+	static double degree[MAX_DEGREES + 1];
+	static KeyMap km;
+	double cents, ref;
+	float inc[TUNING_NOTES];
+	int n, i;
+
+	n = readScale(scl, degree);
+	if (n == 0)
+		return 1;
+
+	if (kbm != NULL) {
+		if (readKeyMap(kbm, &km))
+			return 1;
+	}
+	else {
+		km.size = 0;
+		km.first = 0;
+		km.last = TUNING_NOTES - 1;
+		km.middle = 60;
+		km.refNote = TUNING_REF_NOTE;
+		km.refFreq = TUNING_REF_FREQ;
+		km.octaveDegree = n;
+	}
+
+	/* the reference key must have a pitch in the scale */
+	if (!keyCents(&km, degree, n, km.refNote, &ref))
+		return 1;
+
+	for (i = 0; i < TUNING_NOTES; i++) {
+		if (keyCents(&km, degree, n, i, &cents))
+			inc[i] = km.refFreq * pow(2.0, (cents - ref) / 1200.0) / t->samplerate;
+		else
+			inc[i] = 0;
+	}
+	memcpy(t->inc, inc, sizeof(inc));
+	return 0;
+}
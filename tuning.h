@@ -0,0 +1,83 @@
+
+/*-----------------------------------------------------------------------------------
+    TUNING
+
+    Note and pitch bend tables. All pitch calculations with logarithms or powers
+	are done when a tuning is created or loaded, so that on the audio thread a
+	note is a table lookup and a bend is an interpolated lookup and a multiply.
+
+	-the tables hold phase increments (cycles per sample), not frequencies
+	-the default tuning is 12-tone equal temperament with A4 (note 69) at 440 Hz
+	-other tunings are loaded from Scala files: a scale (.scl) and optionally a
+	 keyboard mapping (.kbm). Keys the mapping leaves out are silent.
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef TUNING_H
+#define TUNING_H
+
+#define TUNING_NOTES 128
+
+/* the reference of the default tuning */
+#define TUNING_REF_NOTE 69
+#define TUNING_REF_FREQ 440.0
+
+/* the bend table covers +-BEND_MAX semitones in steps of 1/BEND_RES semitone */
+#define BEND_MAX  48
+#define BEND_RES  64
+#define BEND_SIZE (2 * BEND_MAX * BEND_RES + 2)
+
+typedef struct
+{
+	float inc[TUNING_NOTES];  /* phase increment of each note, 0 for an unmapped key */
+	float bend[BEND_SIZE];    /* frequency ratios from -BEND_MAX to +BEND_MAX semitones */
+	float samplerate;
+} Tuning;
+
+
+/*---------------------------------------------------------------------------
+	createTuning returns the default tuning for given samplerate
+------------------------------------------------------------------------------*/
+Tuning *createTuning(float samplerate);
+
+void destroyTuning(Tuning *t);
+
+/*---------------------------------------------------------------------------
+	setEqualTuning sets 12-tone equal temperament with the reference note at
+	the reference frequency
+------------------------------------------------------------------------------*/
+void setEqualTuning(Tuning *t, int refNote, double refFreq);
+
+/*---------------------------------------------------------------------------
+	loadScala reads a Scala scale file and a keyboard mapping file. kbm may be
+	NULL, then the scale starts from note 60 and note 69 is 440 Hz. Returns 0
+	on success, 1 if a file cannot be read or is not valid, and the tuning is
+	left unchanged. Not to be called while the tuning is used for rendering.
+------------------------------------------------------------------------------*/
+int loadScala(Tuning *t, const char *scl, const char *kbm);
+
+/* -----------------------------------------------------------------------------
+	noteInc returns the phase increment of a note
+------------------------------------------------------------------------------*/
+static inline float noteInc(const Tuning *t, int note)
+{
+	return t->inc[note & (TUNING_NOTES - 1)];
+}
+
+/* -----------------------------------------------------------------------------
+	bendRatio returns the frequency ratio of a bend in semitones, clamped to
+	+-BEND_MAX. The table is interpolated linearly, the error is below 0.001 cents.
+------------------------------------------------------------------------------*/
+static inline float bendRatio(const Tuning *t, float semitones)
+{
+	float x;
+	int i;
+
+	if (semitones < -BEND_MAX) semitones = -BEND_MAX;
+	if (semitones > BEND_MAX) semitones = BEND_MAX;
+	x = (semitones + BEND_MAX) * BEND_RES;
+	i = (int)x;
+	return t->bend[i] + (x - i) * (t->bend[i + 1] - t->bend[i]);
+}
+
+#endif
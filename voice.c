@@ -0,0 +1,160 @@
+
+#include "voice.h"
+
+
+/* -------------------------------------------------------------------------------------
+	createVoicePool
+------------------------------------------------------------------------------------- */
+VoicePool *createVoicePool(int size)
+{
+	VoicePool *pool = malloc(sizeof(VoicePool));
+
+	if (size < MIN_VOICES) size = MIN_VOICES;
+	if (size > MAX_VOICES) size = MAX_VOICES;
+	pool->size = size;
+
+	resetVoicePool(pool);
+	return pool;
+}
+
+/* -----------------------------------------------------------------------------------
+	resetVoicePool: all voices are put to the free list in order, so that
+	voice 0 is given out first.
+------------------------------------------------------------------------------------- */
+void resetVoicePool(VoicePool *pool)
+{
+	int i, e;
+
+	for (i = 0; i < pool->size; i++) {
+		pool->voice[i].note = -1;
+		pool->voice[i].chan = -1;
+		pool->voice[i].vel = 0;
+		pool->voice[i].sustained = 0;
+		pool->voice[i].age = 0;
+		pool->voice[i].phase = 0;
+		pool->voice[i].inc = pool->voice[i].oinc = 0;
+		pool->voice[i].max = 0;
+		for (e = 0; e < NUM_ENVS; e++)
+			envReset(&pool->voice[i].env[e]);
+		pool->freeList[i] = pool->size - 1 - i;
+	}
+	pool->numFree = pool->size;
+	pool->numActive = 0;
+	pool->limit = pool->size;
+	pool->clock = 0;
+}
+
+/* -----------------------------------------------------------------------------------
+	stealVoice: returns the position of the voice to be stolen in the active list.
+	Voices in release stage are preferred, the quietest of them first. If no voice
+	is releasing, the oldest voice is taken.
+------------------------------------------------------------------------------------- */
+static int stealVoice(VoicePool *pool)
+{
+	int i, quietest = -1, oldest = 0;
+	float level, min = 0;
+	Voice *v;
+
+	for (i = 0; i < pool->numActive; i++) {
+		v = &pool->voice[pool->active[i]];
+		if (v->env[ENV_AMP].stage == REL || v->env[ENV_AMP].stage == OFF) {
+			level = v->env[ENV_AMP].level * v->max;
+			if (quietest < 0 || level < min) {
+				quietest = i;
+				min = level;
+			}
+		}
+		if (v->age < pool->voice[pool->active[oldest]].age)
+			oldest = i;
+	}
+	return (quietest >= 0) ? quietest : oldest;
+}
+
+/* -----------------------------------------------------------------------------------
+	allocVoice:
+------------------------------------------------------------------------------------- */
+Voice *allocVoice(VoicePool *pool)
+{
+	Voice *v;
+
+	if (pool->numFree > 0 && pool->numActive < pool->limit) {
+		pool->numFree--;
+		pool->active[pool->numActive] = pool->freeList[pool->numFree];
+		v = &pool->voice[pool->active[pool->numActive]];
+		pool->numActive++;
+	}
+	else {
+		/* the stolen voice stays in the active list, it is only re-stamped */
+		v = &pool->voice[pool->active[stealVoice(pool)]];
+	}
+	v->sustained = 0;
+	v->age = ++pool->clock;
+	return v;
+}
+
+/* ---------------------------------------------------------------------------------------
+	freeVoice:
+-------------------------------------------------------------------------------------------- */
+void freeVoice(VoicePool *pool, int n)
+{
+	Voice *v = &pool->voice[pool->active[n]];
+	int e;
+
+	for (e = 0; e < NUM_ENVS; e++)
+		envReset(&v->env[e]);
+	v->note = -1;
+	v->chan = -1;
+	v->sustained = 0;
+
+	pool->freeList[pool->numFree++] = pool->active[n];
+	pool->active[n] = pool->active[--pool->numActive];
+}
+
+/* -------------------------------------------------------------------------------------------
+	limitVoices: the quietest voice is searched again for every voice freed, the loop runs
+	only when the limit is lowered
+--------------------------------------------------------------------------------------------- */
+int limitVoices(VoicePool *pool, int limit, int *freed)
+{
+	int i, quietest, n = 0;
+	float level, min;
+	Voice *v;
+
+	if (limit < 1) limit = 1;
+	if (limit > pool->size) limit = pool->size;
+	pool->limit = limit;
+
+	while (pool->numActive > limit) {
+		quietest = 0;
+		min = 0;
+		for (i = 0; i < pool->numActive; i++) {
+			v = &pool->voice[pool->active[i]];
+			level = v->env[ENV_AMP].level * v->max;
+			if (i == 0 || level < min) {
+				quietest = i;
+				min = level;
+			}
+		}
+		if (freed != NULL)
+			freed[n] = pool->active[quietest];
+		n++;
+		freeVoice(pool, quietest);
+	}
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------------
+	findVoice
+--------------------------------------------------------------------------------------------- */
+Voice *findVoice(VoicePool *pool, unsigned char chan, unsigned char note)
+{
+	int i;
+	Voice *v;
+
+	for (i = 0; i < pool->numActive; i++) {
+		v = &pool->voice[pool->active[i]];
+		if (v->note == note && v->chan == chan && v->env[ENV_AMP].stage != OFF)
+			return v;
+	}
+	return NULL;
+}
@@ -0,0 +1,97 @@
+
+/*-----------------------------------------------------------------------------------
+    VOICE
+
+    Fixed-size pool of synthesizer voices. All voices are allocated once when
+	the pool is created, so nothing is allocated while the audio is running.
+
+	-sounding voices are kept in a separate index list, so that rendering only
+	 touches the voices that are actually active
+	-when the pool is full, a voice is stolen: the quietest voice in release
+	 stage if there is one, otherwise the oldest voice
+	-the number of sounding voices can be limited below the pool size, to save
+	 processor time. The quietest voices above the limit are silenced at once
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef VOICE_H
+#define VOICE_H
+
+#include <stdlib.h>
+#include "envelope.h"
+#include "filter.h"
+
+/* limits for the pool size */
+#define MIN_VOICES 32
+#define MAX_VOICES 128
+#define NUM_VOICES 64   /* default pool size */
+
+/* one voice: the oscillator, its envelope states and the note that started it */
+typedef struct
+{
+	short note;          /* midi note number         */
+	short chan;          /* midi channel             */
+	short vel;           /* note on velocity         */
+	int   sustained;     /* key is up, but the hold pedal keeps the voice on */
+	unsigned long age;   /* allocation stamp, smaller is older */
+
+	unsigned int phase;  /* oscillator phase, a full cycle is 2^32 */
+	float inc;           /* current phase increment per sample */
+	float oinc;          /* phase increment of the note without bend */
+	float max;           /* maximum amplitude (velocity) */
+	EnvState env[NUM_ENVS]; /* amplitude, filter and pitch envelopes */
+	FilterState filter;
+} Voice;
+
+
+typedef struct
+{
+	Voice voice[MAX_VOICES];
+	int   active[MAX_VOICES];   /* indices of sounding voices  */
+	int   numActive;
+	int   freeList[MAX_VOICES]; /* indices of unused voices    */
+	int   numFree;
+	int   size;                 /* number of voices in use     */
+	int   limit;                /* most voices sounding at once, <= size */
+	unsigned long clock;        /* counter for voice age stamps */
+} VoicePool;
+
+
+/*---------------------------------------------------------------------------
+	createVoicePool reserves a pool of size voices (MIN_VOICES - MAX_VOICES)
+------------------------------------------------------------------------------*/
+VoicePool *createVoicePool(int size);
+
+/*---------------------------------------------------------------------------
+	resetVoicePool silences all voices and returns them to the free list
+------------------------------------------------------------------------------*/
+void resetVoicePool(VoicePool *pool);
+
+/* -----------------------------------------------------------------------------
+	allocVoice takes a voice from the free list, or steals one if the pool is
+	full. The voice is left in the active list with a fresh age stamp.
+------------------------------------------------------------------------------*/
+Voice *allocVoice(VoicePool *pool);
+
+/* ----------------------------------------------------------------------------
+	freeVoice returns the voice at position n of the active list to the free
+	list. The last active voice is moved to position n, so when freeing inside
+	a loop over the active list, the loop should run backwards.
+-------------------------------------------------------------------------------*/
+void freeVoice(VoicePool *pool, int n);
+
+/* ----------------------------------------------------------------------------
+	limitVoices sets the most voices that may sound at once (1 - size), and frees
+	the quietest active voices above it. The pool indices of the freed voices
+	are written into freed (room for size), unless it is NULL, and their number
+	is returned. Must not be called while voices are being rendered.
+-------------------------------------------------------------------------------*/
+int limitVoices(VoicePool *pool, int limit, int *freed);
+
+/*----------------------------------------------------------------------------
+	findVoice returns the sounding voice playing given note on given channel,
+	or NULL if there is none.
+-----------------------------------------------------------------------------*/
+Voice *findVoice(VoicePool *pool, unsigned char chan, unsigned char note);
+
+#endif
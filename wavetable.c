@@ -0,0 +1,249 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "wavetable.h"
+
+#define NUM_HARM (WT_SIZE / 2)
+
+
+/* -------------------------------------------------------------------------------------
+	fft: in place radix-2 complex fft of n points. inverse = 1 gives the inverse
+	transform without the 1/n scaling. Only used when tables are built.
+------------------------------------------------------------------------------------- */
+static void fft(double *re, double *im, int n, int inverse)
+{
+	int i, j, k, len, bit;
+	double t, ang, wr, wi, ur, ui, vr, vi;
+
+	/* bit reversed reordering */
+	for (i = 1, j = 0; i < n; i++) {
+		for (bit = n >> 1; j & bit; bit >>= 1)
+			j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (len = 2; len <= n; len <<= 1) {
+		ang = (inverse ? 2 : -2) * M_PI / len;
+		for (k = 0; k < len / 2; k++) {
+			wr = cos(ang * k);
+			wi = sin(ang * k);
+			for (i = k; i < n; i += len) {
+				ur = re[i];
+				ui = im[i];
+				vr = re[i + len / 2] * wr - im[i + len / 2] * wi;
+				vi = re[i + len / 2] * wi + im[i + len / 2] * wr;
+				re[i] = ur + vr;
+				im[i] = ui + vi;
+				re[i + len / 2] = ur - vr;
+				im[i + len / 2] = ui - vi;
+			}
+		}
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	buildTables: the tables of all octaves are made from the harmonic amplitudes
+	a (cosine) and b (sine), harmonics 1 to NUM_HARM - 1. Table k keeps only the
+	first NUM_HARM >> k harmonics.
+------------------------------------------------------------------------------------- */
+static void buildTables(Wavetable *w, const double *a, const double *b)
+{
+	static double re[WT_SIZE], im[WT_SIZE];
+	int k, h, n, harm;
+
+	for (k = 0; k < WT_OCTAVES; k++) {
+		harm = NUM_HARM >> k;
+		if (harm > NUM_HARM - 1)
+			harm = NUM_HARM - 1;
+
+		for (n = 0; n < WT_SIZE; n++)
+			re[n] = im[n] = 0;
+		for (h = 1; h <= harm; h++) {
+			re[h] = a[h] * 0.5;
+			im[h] = -b[h] * 0.5;
+			re[WT_SIZE - h] = a[h] * 0.5;
+			im[WT_SIZE - h] = b[h] * 0.5;
+		}
+		fft(re, im, WT_SIZE, 1);
+
+		for (n = 0; n < WT_SIZE; n++)
+			w->table[k][n] = re[n];
+		w->table[k][WT_SIZE] = w->table[k][0];
+		w->table[k][WT_SIZE + 1] = w->table[k][1];
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	createWavetables: the harmonic series of the waveforms match the shapes of the
+	original naive oscillators: the sawtooth falls from 1 to -1, the triangle starts
+	from -1 and peaks at half cycle.
+------------------------------------------------------------------------------------- */
+WavetableSet *createWavetables()
+{
+	WavetableSet *set = malloc(sizeof(WavetableSet));
+	static double a[NUM_HARM], b[NUM_HARM];
+	int h;
+
+	for (h = 0; h <= NUM_WAVES; h++)
+		set->wave[h] = NULL;
+
+	/* sawtooth: (2 / pi) * sum sin(h x) / h */
+	for (h = 0; h < NUM_HARM; h++) {
+		a[h] = 0;
+		b[h] = (h > 0) ? (2 / M_PI) / h : 0;
+	}
+	set->wave[SAW] = malloc(sizeof(Wavetable));
+	buildTables(set->wave[SAW], a, b);
+	set->wave[PUL] = set->wave[SAW];
+
+	/* triangle: -(8 / pi^2) * sum cos(h x) / h^2, odd harmonics */
+	for (h = 0; h < NUM_HARM; h++) {
+		a[h] = (h % 2 == 1) ? -(8 / (M_PI * M_PI)) / ((double)h * h) : 0;
+		b[h] = 0;
+	}
+	set->wave[TRI] = malloc(sizeof(Wavetable));
+	buildTables(set->wave[TRI], a, b);
+
+	/* sine */
+	for (h = 0; h < NUM_HARM; h++)
+		a[h] = b[h] = 0;
+	b[1] = 1;
+	set->wave[SIN] = malloc(sizeof(Wavetable));
+	buildTables(set->wave[SIN], a, b);
+
+	return set;
+}
+
+/* -------------------------------------------------------------------------------------
+	destroyWavetables
+------------------------------------------------------------------------------------- */
+void destroyWavetables(WavetableSet *set)
+{
+	free(set->wave[SAW]);
+	free(set->wave[TRI]);
+	free(set->wave[SIN]);
+	free(set->wave[USR]);
+	free(set);
+}
+
+/* -------------------------------------------------------------------------------------
+	loadWavetable: the samples of the file are resampled to WT_SIZE points, analysed
+	with an fft, and the tables are built from the harmonics like for the built-in
+	waveforms. The result is scaled so that the full bandwidth table peaks at 1.
+------------------------------------------------------------------------------------- */
+int loadWavetable(WavetableSet *set, const char *filename)
+{
+	static double re[WT_SIZE], im[WT_SIZE], a[NUM_HARM], b[NUM_HARM];
+	FILE *f;
+	char line[100];
+	float *samples = NULL;
+	int count = 0, reserved = 0, n, k, h;
+	double x, frac, peak = 0;
+	Wavetable *w;
+
+	f = fopen(filename, "r");
+	if (f == NULL)
+		return 1;
+	while (fgets(line, 100, f) != NULL) {
+		if (sscanf(line, "%lf", &x) != 1)
+			continue;
+		if (count == reserved) {
+			reserved = reserved ? reserved * 2 : 1024;
+			samples = realloc(samples, reserved * sizeof(float));
+		}
+		samples[count++] = x;
+	}
+	fclose(f);
+	if (count < 2) {
+		free(samples);
+		return 1;
+	}
+
+	/* resample one cycle to the table size by linear interpolation */
+	for (n = 0; n < WT_SIZE; n++) {
+		x = (double)n * count / WT_SIZE;
+		k = (int)x;
+		frac = x - k;
+		re[n] = samples[k] + frac * (samples[(k + 1) % count] - samples[k]);
+		im[n] = 0;
+	}
+	free(samples);
+
+	fft(re, im, WT_SIZE, 0);
+	for (h = 0; h < NUM_HARM; h++) {
+		a[h] = (h > 0) ? 2 * re[h] / WT_SIZE : 0; /* DC is dropped */
+		b[h] = (h > 0) ? -2 * im[h] / WT_SIZE : 0;
+	}
+
+	w = malloc(sizeof(Wavetable));
+	buildTables(w, a, b);
+	for (n = 0; n < WT_SIZE; n++)
+		if (fabs(w->table[0][n]) > peak)
+			peak = fabs(w->table[0][n]);
+	if (peak > 0) {
+		for (k = 0; k < WT_OCTAVES; k++)
+			for (n = 0; n < WT_SIZE + 2; n++)
+				w->table[k][n] /= peak;
+	}
+
+	free(set->wave[USR]);
+	set->wave[USR] = w;
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	wtOctave: table k is free of aliasing while inc * WT_SIZE < 2^k
+------------------------------------------------------------------------------------- */
+int wtOctave(float inc)
+{
+	int e;
+
+	frexpf(inc * WT_SIZE, &e);
+	if (e < 0)
+		return 0;
+	if (e >= WT_OCTAVES)
+		return WT_OCTAVES - 1;
+	return e;
+}
+
+/* -------------------------------------------------------------------------------------
+	wtRenderNaive: the sawtooth falls from 1 to -1, the triangle rises from -1 to 1 at
+	half cycle, and the pulse is 1 for the first pw of the cycle. The phase moved by half
+	a cycle is a sawtooth as a signed integer.
+------------------------------------------------------------------------------------- */
+unsigned int wtRenderNaive(float *dst, int waveform, unsigned int phase, unsigned int inc,
+                           int dinc, float pw, int n)
+{
+	const float scale = 1.0f / 2147483648.0f;
+	unsigned int width = (unsigned int)(pw * 4294967296.0f);
+	int i;
+
+	/* one loop per waveform, so that the loops stay simple */
+	if (waveform == PUL) {
+		for (i = 0; i < n; i++) {
+			dst[i] = (phase < width) ? 1 : -1;
+			phase += inc;
+			inc += dinc;
+		}
+	}
+	else if (waveform == TRI) {
+		for (i = 0; i < n; i++) {
+			dst[i] = 1 - 2 * fabsf((int)(phase - 0x80000000u) * scale);
+			phase += inc;
+			inc += dinc;
+		}
+	}
+	else {
+		for (i = 0; i < n; i++) {
+			dst[i] = (int)(0x80000000u - phase) * scale;
+			phase += inc;
+			inc += dinc;
+		}
+	}
+	return phase;
+}
@@ -0,0 +1,118 @@
+
+/*-----------------------------------------------------------------------------------
+    WAVETABLE
+
+    Band-limited wavetable oscillator. Every waveform is stored as a set of single
+	cycle tables, one per octave, each containing only the harmonics that stay below
+	the Nyquist frequency for the notes of that octave. The tables are built once at
+	startup from the harmonic spectrum of the waveform, so no aliasing is produced
+	and a sample costs one interpolated table lookup.
+
+	-the phase is a 32-bit fixed point accumulator, a full cycle is 2^32, so it
+	 wraps around by itself and keeps its precision however long a note is.
+	 The top WT_BITS bits are the table index and the rest the fraction
+	-increments are converted from cycles per sample with wtInc, once for each
+	 change of frequency
+	-the pulse wave is made of two sawtooth lookups, so its width can change freely
+	-a user waveform can be loaded from a text file with one sample value per line
+	-pulse, triangle and sawtooth can also be computed directly from the phase,
+	 without band limiting. This naive form aliases, but costs no table lookups,
+	 and is used when the synth is short of processor time
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include "dsp.h"
+
+#define WT_BITS    11
+#define WT_SIZE    (1 << WT_BITS)   /* samples in one table */
+#define WT_OCTAVES WT_BITS          /* table k holds (WT_SIZE / 2) >> k harmonics */
+#define WT_FRAC_BITS (32 - WT_BITS)
+
+/* waveforms, the numbering is shared with the waveform menu and controller */
+#define PUL 1
+#define TRI 2
+#define SAW 3
+#define SIN 4
+#define USR 5
+#define NUM_WAVES 5
+
+/* the tables of one waveform. Each table has two extra samples at the end, copies of
+   the first ones, so that interpolation never needs to wrap around, not even when
+   rounding gives a phase of exactly 1. */
+typedef struct
+{
+	float table[WT_OCTAVES][WT_SIZE + 2];
+} Wavetable;
+
+typedef struct
+{
+	Wavetable *wave[NUM_WAVES + 1]; /* indexed by waveform number, PUL shares the SAW tables */
+} WavetableSet;
+
+
+/*---------------------------------------------------------------------------
+	createWavetables builds the tables for the built-in waveforms. USR is
+	left empty (NULL) until loadWavetable is called.
+------------------------------------------------------------------------------*/
+WavetableSet *createWavetables();
+
+/*---------------------------------------------------------------------------
+	destroyWavetables
+------------------------------------------------------------------------------*/
+void destroyWavetables(WavetableSet *set);
+
+/* -----------------------------------------------------------------------------
+	loadWavetable reads one cycle of a waveform from a text file, one sample per
+	line, and builds the band-limited USR tables from it. Must not be called
+	while the audio is running. Returns 0 on success.
+------------------------------------------------------------------------------*/
+int loadWavetable(WavetableSet *set, const char *filename);
+
+/* -----------------------------------------------------------------------------
+	wtOctave returns the table to use for a phase increment (cycles per sample)
+------------------------------------------------------------------------------*/
+int wtOctave(float inc);
+
+/* -----------------------------------------------------------------------------
+	wtInc converts a phase increment in cycles per sample into the fixed point
+	phase. Increments are limited to half a cycle, the Nyquist frequency.
+------------------------------------------------------------------------------*/
+static inline unsigned int wtInc(float inc)
+{
+	if (inc <= 0)
+		return 0;
+	if (inc >= 0.5f)
+		return 0x80000000u;
+	return (unsigned int)(inc * 4294967296.0f);
+}
+
+/* -----------------------------------------------------------------------------
+	wtRender writes n samples of table t into dst, starting from phase and
+	advancing inc every sample, inc changing by dinc every sample. Returns the
+	phase after the block.
+	wtRenderPulse does the same for a pulse wave of width pw, made from
+	sawtooth table t as the difference of two sawtooths pw cycles apart.
+------------------------------------------------------------------------------*/
+static inline unsigned int wtRender(float *dst, const float *t, unsigned int phase,
+                                    unsigned int inc, int dinc, int n)
+{
+	return dsp.osc(dst, t, WT_BITS, phase, inc, dinc, n);
+}
+
+static inline unsigned int wtRenderPulse(float *dst, const float *t, unsigned int phase,
+                                         unsigned int inc, int dinc, float pw, int n)
+{
+	return dsp.oscPulse(dst, t, WT_BITS, phase, inc, dinc, (unsigned int)(pw * 4294967296.0f), 2 * pw - 1, n);
+}
+
+/* -----------------------------------------------------------------------------
+	wtRenderNaive does the same for the naive PUL, TRI or SAW waveform, with the
+	same shape and phase as the tables
+------------------------------------------------------------------------------*/
+unsigned int wtRenderNaive(float *dst, int waveform, unsigned int phase, unsigned int inc,
+                           int dinc, float pw, int n);
+
+#endif
@@ -0,0 +1,132 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include "wavfile.h"
+
+#define WAVE_FORMAT_IEEE_FLOAT 3
+
+
+/* -------------------------------------------------------------------------------------
+	putLE: little endian integer of n bytes
+------------------------------------------------------------------------------------- */
+static void putLE(unsigned char *p, unsigned long long v, int n)
+{
+	while (n-- > 0) {
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+	wavHeader: RIFF header, fmt chunk and the start of the data chunk. Sizes over
+	4 GB do not fit into the header, they are written as the maximum value.
+------------------------------------------------------------------------------------- */
+void wavHeader(unsigned char *h, unsigned int rate, int channels, unsigned long long frames)
+{
+	unsigned long long bytes = frames * channels * sizeof(float);
+
+	if (bytes > 0xFFFFFFFFULL - 36)
+		bytes = 0xFFFFFFFFULL - 36;
+
+	memcpy(h, "RIFF", 4);
+	putLE(h + 4, 36 + bytes, 4);
+	memcpy(h + 8, "WAVE", 4);
+	memcpy(h + 12, "fmt ", 4);
+	putLE(h + 16, 16, 4);                                 /* fmt chunk size */
+	putLE(h + 20, WAVE_FORMAT_IEEE_FLOAT, 2);
+	putLE(h + 22, channels, 2);
+	putLE(h + 24, rate, 4);
+	putLE(h + 28, rate * channels * sizeof(float), 4);    /* bytes per second */
+	putLE(h + 32, channels * sizeof(float), 2);           /* bytes per frame  */
+	putLE(h + 34, 8 * sizeof(float), 2);                  /* bits per sample  */
+	memcpy(h + 36, "data", 4);
+	putLE(h + 40, bytes, 4);
+}
+
+/* -------------------------------------------------------------------------------------
+	openWav
+------------------------------------------------------------------------------------- */
+WavFile *openWav(const char *filename, unsigned int rate, int channels)
+{
+	unsigned char h[WAV_HEADER_SIZE];
+	WavFile *wav;
+	FILE *f = fopen(filename, "wb");
+
+	if (f == NULL)
+		return NULL;
+	wavHeader(h, rate, channels, 0);
+	if (fwrite(h, 1, WAV_HEADER_SIZE, f) != WAV_HEADER_SIZE) {
+		fclose(f);
+		return NULL;
+	}
+
+	wav = malloc(sizeof(WavFile));
+	wav->f = f;
+	wav->rate = rate;
+	wav->channels = channels;
+	wav->frames = 0;
+	return wav;
+}
+
+/* -------------------------------------------------------------------------------------
+	writeWav
+------------------------------------------------------------------------------------- */
+int writeWav(WavFile *wav, const float *samples, unsigned long frames)
+{
+	size_t n = (size_t)frames * wav->channels;
+
+	if (fwrite(samples, sizeof(float), n, wav->f) != n)
+		return 1;
+	wav->frames += frames;
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+	closeWav
+------------------------------------------------------------------------------------- */
+void closeWav(WavFile *wav)
+{
+	unsigned char h[WAV_HEADER_SIZE];
+
+	wavHeader(h, wav->rate, wav->channels, wav->frames);
+	fseek(wav->f, 0, SEEK_SET);
+	fwrite(h, 1, WAV_HEADER_SIZE, wav->f);
+	fclose(wav->f);
+	free(wav);
+}
+
+/* -------------------------------------------------------------------------------------
+	wav64Header: the first chunk is JUNK while the file is under 4 GB, and becomes the
+	ds64 chunk of RF64 with the 64-bit sizes when it is not. The JUNK chunk before the
+	data pads the header to size bytes.
+------------------------------------------------------------------------------------- */
+void wav64Header(unsigned char *h, int size, unsigned int rate, int channels, unsigned long long frames)
+{
+	unsigned long long bytes = frames * channels * sizeof(float);
+	unsigned long long riff = size - 8 + bytes;
+	int big = riff > 0xFFFFFFFFULL;
+
+	memset(h, 0, size);
+	memcpy(h, big ? "RF64" : "RIFF", 4);
+	putLE(h + 4, big ? 0xFFFFFFFF : riff, 4);
+	memcpy(h + 8, "WAVE", 4);
+	memcpy(h + 12, big ? "ds64" : "JUNK", 4);
+	putLE(h + 16, 28, 4);
+	if (big) {
+		putLE(h + 20, riff, 8);
+		putLE(h + 28, bytes, 8);
+		putLE(h + 36, frames, 8);                         /* table length at 44 stays 0 */
+	}
+	memcpy(h + 48, "fmt ", 4);
+	putLE(h + 52, 16, 4);
+	putLE(h + 56, WAVE_FORMAT_IEEE_FLOAT, 2);
+	putLE(h + 58, channels, 2);
+	putLE(h + 60, rate, 4);
+	putLE(h + 64, rate * channels * sizeof(float), 4);
+	putLE(h + 68, channels * sizeof(float), 2);
+	putLE(h + 70, 8 * sizeof(float), 2);
+	memcpy(h + 72, "JUNK", 4);
+	putLE(h + 76, size - 88, 4);
+	memcpy(h + size - 8, "data", 4);
+	putLE(h + size - 4, big ? 0xFFFFFFFF : bytes, 4);
+}
@@ -0,0 +1,62 @@
+
+/*-----------------------------------------------------------------------------------
+    WAVFILE
+
+    Writer for WAV files with 32-bit float samples. The sizes in the header are
+	filled in when the file is closed.
+
+	-samples are written in the byte order of the machine, which must be little
+	 endian (x86 and ARM both are)
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <stdio.h>
+
+#define WAV_HEADER_SIZE 44
+
+/* smallest header of wav64Header */
+#define WAV64_HEADER_MIN 88
+
+typedef struct
+{
+	FILE *f;
+	unsigned int rate;
+	int channels;
+	unsigned long long frames;  /* frames written so far */
+} WavFile;
+
+
+/*---------------------------------------------------------------------------
+	openWav creates the file and writes a header for it. Returns NULL if the
+	file cannot be created.
+------------------------------------------------------------------------------*/
+WavFile *openWav(const char *filename, unsigned int rate, int channels);
+
+/*---------------------------------------------------------------------------
+	writeWav appends frames of interleaved samples. Returns 0 on success.
+------------------------------------------------------------------------------*/
+int writeWav(WavFile *wav, const float *samples, unsigned long frames);
+
+/*---------------------------------------------------------------------------
+	closeWav fixes the sizes in the header and closes the file
+------------------------------------------------------------------------------*/
+void closeWav(WavFile *wav);
+
+/*---------------------------------------------------------------------------
+	wavHeader fills h with a WAV_HEADER_SIZE byte header for a file of given
+	length in frames
+------------------------------------------------------------------------------*/
+void wavHeader(unsigned char *h, unsigned int rate, int channels, unsigned long long frames);
+
+/*---------------------------------------------------------------------------
+	wav64Header fills h with a header of size bytes (at least WAV64_HEADER_MIN,
+	even) that holds any length: a WAV file up to 4 GB and an RF64 file beyond
+	that. The size can be chosen so that the samples start on an aligned
+	offset of the file.
+------------------------------------------------------------------------------*/
+void wav64Header(unsigned char *h, int size, unsigned int rate, int channels, unsigned long long frames);
+
+#endif
@@ -0,0 +1,187 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include "workers.h"
+
+/* an idle worker spins this many rounds before it starts to nap */
+#define WORKER_SPINS 20000
+
+/* length of one nap of an idle worker (nanoseconds) */
+#define WORKER_IDLE_NS 50000
+
+#define JOB_GEN(w)   ((unsigned int)((w) >> 32))
+#define JOB_COUNT(w) ((int)(((w) >> 16) & 0xFFFF))
+#define JOB_NEXT(w)  ((int)((w) & 0xFFFF))
+
+
+/* -------------------------------------------------------------------------------------
+	cpuRelax: tells the processor that this is a spin loop
+------------------------------------------------------------------------------------- */
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ volatile("yield");
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+	takeItem: claims the next item of the job, returns -1 if the job has no items left
+	or is not the job of generation gen
+------------------------------------------------------------------------------------- */
+static int takeItem(WorkerPool *pool, unsigned int gen)
+{
+	unsigned long long w = atomic_load_explicit(&pool->work, memory_order_acquire);
+
+	while (JOB_GEN(w) == gen && JOB_NEXT(w) < JOB_COUNT(w)) {
+		if (atomic_compare_exchange_weak_explicit(&pool->work, &w, w + 1,
+		                                          memory_order_acq_rel, memory_order_acquire))
+			return JOB_NEXT(w);
+	}
+	return -1;
+}
+
+/* -------------------------------------------------------------------------------------
+	runItems: items are taken and run until the job has none left
+------------------------------------------------------------------------------------- */
+static int runItems(WorkerPool *pool, unsigned int gen, int thread)
+{
+	int item, done = 0;
+
+	while ((item = takeItem(pool, gen)) >= 0) {
+		pool->func(pool->ctx, item, thread);
+		atomic_fetch_add_explicit(&pool->completed, 1, memory_order_release);
+		done++;
+	}
+	return done;
+}
+
+/* -------------------------------------------------------------------------------------
+	worker: the thread loop
+------------------------------------------------------------------------------------- */
+static void *worker(void *arg)
+{
+	WorkerPool *pool = ((WorkerArg*)arg)->pool;
+	int thread = ((WorkerArg*)arg)->thread;
+	struct timespec nap = { 0, WORKER_IDLE_NS };
+	unsigned long long w;
+	int spins = 0;
+
+	while (atomic_load_explicit(&pool->running, memory_order_relaxed)) {
+		w = atomic_load_explicit(&pool->work, memory_order_acquire);
+		if (JOB_NEXT(w) < JOB_COUNT(w) && runItems(pool, JOB_GEN(w), thread) > 0) {
+			spins = 0;
+			continue;
+		}
+		if (spins < WORKER_SPINS) {
+			spins++;
+			cpuRelax();
+		}
+		else
+			nanosleep(&nap, NULL);
+	}
+	return NULL;
+}
+
+/* -------------------------------------------------------------------------------------
+	pinThread: worker n runs on core n, the audio thread usually stays on core 0
+------------------------------------------------------------------------------------- */
+static void pinThread(pthread_t t, int core)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cores < 2)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(core % cores, &set);
+	pthread_setaffinity_np(t, sizeof(set), &set);
+#else
+	(void)t;
+	(void)core;
+#endif
+}
+
+/* -------------------------------------------------------------------------------------
+	createWorkerPool
+------------------------------------------------------------------------------------- */
+WorkerPool *createWorkerPool(int numThreads, WorkFunc func, void *ctx)
+{
+	WorkerPool *pool;
+	const char *env;
+	int i;
+
+	if (numThreads < 0) {
+		env = getenv("ESP1_THREADS");
+		if (env != NULL)
+			numThreads = atoi(env);
+		else
+			numThreads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	}
+	if (numThreads < 0) numThreads = 0;
+	if (numThreads > MAX_WORKERS) numThreads = MAX_WORKERS;
+
+	if (posix_memalign((void**)&pool, CACHE_LINE, sizeof(WorkerPool)) != 0)
+		return NULL;
+	atomic_init(&pool->work, 0);
+	atomic_init(&pool->completed, 0);
+	atomic_init(&pool->running, 1);
+	pool->func = func;
+	pool->ctx = ctx;
+	pool->numThreads = 0;
+
+	for (i = 0; i < numThreads; i++) {
+		pool->arg[i].pool = pool;
+		pool->arg[i].thread = i + 1;
+		if (pthread_create(&pool->thread[i], NULL, worker, &pool->arg[i]) != 0) {
+			printf("Cannot start worker thread, using %d workers\n", i);
+			break;
+		}
+		pinThread(pool->thread[i], i + 1);
+		pool->numThreads++;
+	}
+	return pool;
+}
+
+/* -------------------------------------------------------------------------------------
+	destroyWorkerPool
+------------------------------------------------------------------------------------- */
+void destroyWorkerPool(WorkerPool *pool)
+{
+	int i;
+
+	if (pool == NULL)
+		return;
+	atomic_store(&pool->running, 0);
+	for (i = 0; i < pool->numThreads; i++)
+		pthread_join(pool->thread[i], NULL);
+	free(pool);
+}
+
+/* -------------------------------------------------------------------------------------
+	workRun: the job is published with a new generation, after the counter of completed
+	items has been cleared. All items of the previous job were completed before, so no
+	thread can be working on it anymore.
+------------------------------------------------------------------------------------- */
+void workRun(WorkerPool *pool, int count)
+{
+	unsigned long long w = atomic_load_explicit(&pool->work, memory_order_relaxed);
+	unsigned int gen = JOB_GEN(w) + 1;
+
+	atomic_store_explicit(&pool->completed, 0, memory_order_relaxed);
+	atomic_store_explicit(&pool->work, ((unsigned long long)gen << 32) | ((unsigned long long)count << 16),
+	                      memory_order_release);
+
+	runItems(pool, gen, 0);
+
+	/* barrier: wait for the items the workers are still rendering */
+	while (atomic_load_explicit(&pool->completed, memory_order_acquire) < count)
+		cpuRelax();
+}
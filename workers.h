@@ -0,0 +1,75 @@
+/*-----------------------------------------------------------------------------------
+    WORKERS
+
+    Pool of worker threads that help the audio thread render. The audio thread
+	posts a job of count items and works on it too; every thread takes the next
+	unclaimed item from a shared atomic counter until none are left, so items of
+	uneven cost spread evenly over the threads. The audio thread then spins until
+	all items are completed.
+
+	-the work function and its context are fixed when the pool is created
+	-the workers never allocate memory or take locks. An idle worker spins for a
+	 while and then sleeps in short naps, so a job is picked up without a wakeup
+	 call from the audio thread
+	-each worker is pinned to its own core where the system allows it
+	-a job is one 64-bit atomic word of generation, item count and next item, so a
+	 worker that wakes up late can never take items of a newer job by mistake
+
+----------------------------------------------------------------------------------------*/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ringbuf.h"
+
+#define MAX_WORKERS 8
+
+/* work function: item is the number of the item, thread is 0 for the thread that
+   called workRun and 1 - numThreads for the workers */
+typedef void (*WorkFunc)(void *ctx, int item, int thread);
+
+struct WorkerPool;
+
+/* what a worker thread is started with */
+typedef struct
+{
+	struct WorkerPool *pool;
+	int thread;
+} WorkerArg;
+
+typedef struct WorkerPool
+{
+	_Alignas(CACHE_LINE) atomic_ullong work;  /* generation << 32 | count << 16 | next item */
+	_Alignas(CACHE_LINE) atomic_int completed;
+	_Alignas(CACHE_LINE) atomic_int running;
+
+	WorkFunc  func;
+	void     *ctx;
+	int       numThreads;
+	pthread_t thread[MAX_WORKERS];
+	WorkerArg arg[MAX_WORKERS];
+} WorkerPool;
+
+
+/*---------------------------------------------------------------------------
+	createWorkerPool starts numThreads workers (0 - MAX_WORKERS). If numThreads
+	is negative, one worker is started for each core but one, or the number
+	given in the ESP1_THREADS environment variable. Returns NULL on failure.
+------------------------------------------------------------------------------*/
+WorkerPool *createWorkerPool(int numThreads, WorkFunc func, void *ctx);
+
+/*---------------------------------------------------------------------------
+	destroyWorkerPool stops and joins the workers
+------------------------------------------------------------------------------*/
+void destroyWorkerPool(WorkerPool *pool);
+
+/* -----------------------------------------------------------------------------
+	workRun runs items 0 - count-1 (count < 65536) on the calling thread and the
+	workers, and returns when all of them are completed. Must be called from
+	one thread only.
+------------------------------------------------------------------------------*/
+void workRun(WorkerPool *pool, int count);
+
+#endif